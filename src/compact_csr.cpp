@@ -0,0 +1,83 @@
+#include "compact_csr.h"
+
+namespace {
+
+    bool rows_sorted(const WeightsCSR& csr)
+    {
+        for (int i = 0; i < csr.num_obs; ++i) {
+            for (size_t k = csr.offsets[i] + 1; k < csr.offsets[i + 1]; ++k) {
+                if (csr.nbrs[k] < csr.nbrs[k - 1]) return false;
+            }
+        }
+        return true;
+    }
+
+    void put_varint(uint32_t v, std::vector<uint8_t>& out)
+    {
+        while (v >= 0x80) {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+}
+
+size_t CompactCSR::GetMemorySize() const
+{
+    return (offsets.size() + byte_offsets.size()) * sizeof(size_t) + nbrs.size() * sizeof(int32_t) +
+           packed_nbrs.size() + weights.size() * sizeof(float);
+}
+
+CompactCSR CSRToCompact(const WeightsCSR& csr, bool use_varint)
+{
+    CompactCSR compact;
+    compact.num_obs = csr.num_obs;
+    compact.offsets = csr.offsets;
+    compact.is_varint = use_varint && rows_sorted(csr);
+
+    if (compact.is_varint) {
+        compact.byte_offsets.resize(csr.num_obs + 1, 0);
+        compact.packed_nbrs.reserve(csr.nbrs.size());
+        for (int i = 0; i < csr.num_obs; ++i) {
+            long prev = 0;
+            for (size_t k = csr.offsets[i]; k < csr.offsets[i + 1]; ++k) {
+                put_varint((uint32_t)(csr.nbrs[k] - prev), compact.packed_nbrs);
+                prev = csr.nbrs[k];
+            }
+            compact.byte_offsets[i + 1] = compact.packed_nbrs.size();
+        }
+        // decoding is slower than reading int32, so keep the varint ids only
+        // if they take at most half the memory (gaps below 128 on average,
+        // e.g. in spatial order)
+        if (compact.packed_nbrs.size() > 2 * csr.nbrs.size()) {
+            compact.is_varint = false;
+            std::vector<size_t>().swap(compact.byte_offsets);
+            std::vector<uint8_t>().swap(compact.packed_nbrs);
+        } else {
+            std::vector<uint8_t>(compact.packed_nbrs).swap(compact.packed_nbrs);
+        }
+    }
+    if (!compact.is_varint) {
+        compact.nbrs.assign(csr.nbrs.begin(), csr.nbrs.end());
+    }
+    compact.weights.assign(csr.weights.begin(), csr.weights.end());
+    return compact;
+}
+
+CSRRows MakeRows(const WeightsCSR& csr)
+{
+    CSRRows rows = {&csr.offsets[0], csr.nbrs.empty() ? 0 : &csr.nbrs[0]};
+    return rows;
+}
+
+Int32Rows MakeInt32Rows(const CompactCSR& csr)
+{
+    Int32Rows rows = {&csr.offsets[0], csr.nbrs.empty() ? 0 : &csr.nbrs[0]};
+    return rows;
+}
+
+VarintRows MakeVarintRows(const CompactCSR& csr)
+{
+    VarintRows rows = {&csr.offsets[0], &csr.byte_offsets[0], csr.packed_nbrs.empty() ? 0 : &csr.packed_nbrs[0]};
+    return rows;
+}
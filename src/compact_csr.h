@@ -0,0 +1,135 @@
+#ifndef JSGEODA_COMPACT_CSR_H
+#define JSGEODA_COMPACT_CSR_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include "weights_csr.h"
+
+/**
+ * CompactCSR
+ *
+ * WeightsCSR with 32-bit neighbor ids and float weights: half the memory of
+ * long ids and double weights on native builds.
+ *
+ * When every row is sorted by id (e.g. distance band and contiguity weights,
+ * or any weights in spatial order), the ids can be stored instead as the
+ * varint-encoded gaps to the previous id of the row. Neighbors are close in
+ * id, so most gaps take one byte.
+ */
+struct CompactCSR {
+    int num_obs;
+    bool is_varint;
+    std::vector<size_t> offsets;      // neighbors (and weights) of row i: [offsets[i], offsets[i+1])
+    std::vector<int32_t> nbrs;        // empty if is_varint
+    std::vector<size_t> byte_offsets; // encoded ids of row i: packed_nbrs[byte_offsets[i] .. byte_offsets[i+1])
+    std::vector<uint8_t> packed_nbrs;
+    std::vector<float> weights;       // empty for binary weights
+
+    CompactCSR() : num_obs(0), is_varint(false) {}
+
+    size_t GetNbrSize(int obs_idx) const { return offsets[obs_idx + 1] - offsets[obs_idx]; }
+
+    size_t GetMemorySize() const;
+};
+
+/**
+ * Convert CSR weights to the compact layout. The ids are varint-encoded if
+ * use_varint, every row of csr is sorted by id, and the encoded ids take at
+ * most 2 bytes per neighbor on average; otherwise they are stored as int32.
+ */
+CompactCSR CSRToCompact(const WeightsCSR& csr, bool use_varint);
+
+/**
+ * Row views
+ *
+ * The kernels of the spatial lag and LISA routines are templates over a row
+ * view, so each layout gets its own compiled loop and nothing is expanded:
+ *
+ *     for (typename Rows::Cursor c = rows.Row(i); c.Next(); ) {
+ *         data[c.Nbr()] * weights[c.Pos()];
+ *     }
+ *
+ * Pos() is the position of the neighbor in the weights arrays.
+ */
+template <class Id>
+struct PlainRows {
+    const size_t* offsets;
+    const Id* nbrs;
+
+    struct Cursor {
+        const Id* nbrs;
+        size_t pos;
+        size_t end;
+
+        bool Next() { return ++pos < end; }
+        long Nbr() const { return (long)nbrs[pos]; }
+        size_t Pos() const { return pos; }
+    };
+
+    Cursor Row(int i) const
+    {
+        // pos starts one before the row (wrapping around for row 0): Next()
+        // increments it before it is read
+        Cursor c = {nbrs, offsets[i] - 1, offsets[i + 1]};
+        return c;
+    }
+
+    size_t Size(int i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+typedef PlainRows<long> CSRRows;
+
+typedef PlainRows<int32_t> Int32Rows;
+
+struct VarintRows {
+    const size_t* offsets;
+    const size_t* byte_offsets;
+    const uint8_t* packed_nbrs;
+
+    struct Cursor {
+        const uint8_t* p;
+        const uint8_t* end;
+        long id;
+        size_t pos;
+
+        bool Next()
+        {
+            if (p >= end) return false;
+            uint32_t gap = *p++;
+            if (gap >= 0x80) {
+                // multi-byte gap (rare in spatial order)
+                gap &= 0x7f;
+                int shift = 7;
+                uint8_t b;
+                do {
+                    b = *p++;
+                    gap |= (uint32_t)(b & 0x7f) << shift;
+                    shift += 7;
+                } while (b & 0x80);
+            }
+            id += gap;
+            ++pos;
+            return true;
+        }
+        long Nbr() const { return id; }
+        size_t Pos() const { return pos; }
+    };
+
+    Cursor Row(int i) const
+    {
+        Cursor c = {packed_nbrs + byte_offsets[i], packed_nbrs + byte_offsets[i + 1], 0, offsets[i] - 1};
+        return c;
+    }
+
+    size_t Size(int i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+CSRRows MakeRows(const WeightsCSR& csr);
+
+Int32Rows MakeInt32Rows(const CompactCSR& csr);
+
+VarintRows MakeVarintRows(const CompactCSR& csr);
+
+#endif //JSGEODA_COMPACT_CSR_H
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#include "parallel.h"
+#include "contiguity.h"
+
+namespace {
+
+    // number of hash shards per thread: more shards than threads keeps the
+    // per-shard sort small and balances the work between threads
+    const int SHARDS_PER_THREAD = 4;
+
+    // mark an item that is copied into an adjacent grid cell (threshold mode)
+    const int GHOST_FLAG = 1;
+
+    struct ContigItem {
+        uint64_t key;
+        int poly;
+        int pt;   // vertex (queen), or first end point of the edge (rook)
+        int pt2;  // second end point of the edge (rook)
+        int flags;
+
+        bool operator<(const ContigItem& o) const {
+            return key < o.key || (key == o.key && poly < o.poly);
+        }
+    };
+
+    inline uint64_t mix64(uint64_t x)
+    {
+        // splitmix64 finalizer
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    inline uint64_t double_bits(double v)
+    {
+        if (v == 0) v = 0; // -0.0 and 0.0 are the same coordinate
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        return bits;
+    }
+
+    inline uint64_t hash_point(const gda::Point& p)
+    {
+        return mix64(double_bits(p.x) + 0x9e3779b97f4a7c15ULL * mix64(double_bits(p.y)));
+    }
+
+    inline uint64_t hash_cell(int64_t cx, int64_t cy)
+    {
+        return mix64((uint64_t)cx + 0x9e3779b97f4a7c15ULL * mix64((uint64_t)cy));
+    }
+
+    inline bool point_less(const gda::Point& a, const gda::Point& b)
+    {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    }
+
+    inline bool same_point(const gda::Point& a, const gda::Point& b, double threshold)
+    {
+        if (threshold <= 0) {
+            return a.x == b.x && a.y == b.y;
+        }
+        return std::fabs(a.x - b.x) <= threshold && std::fabs(a.y - b.y) <= threshold;
+    }
+
+    class ContigHasher {
+    public:
+        ContigHasher(const gda::MainMap& main_map, bool is_queen, double threshold, int n_shards)
+        : main_map(main_map), is_queen(is_queen), threshold(threshold), n_shards(n_shards) {}
+
+        // hash the vertices/edges of polygon poly into the shard buckets
+        void AddPolygon(int poly, std::vector<std::vector<ContigItem> >& buckets) const
+        {
+            gda::GeometryContent* geom = main_map.records[poly];
+            if (geom == 0 || main_map.shape_type != gda::POLYGON) return;
+            gda::PolygonContents* pc = dynamic_cast<gda::PolygonContents*>(geom);
+            if (pc == 0) return;
+
+            const std::vector<gda::Point>& pts = pc->points;
+            for (int p = 0; p < pc->num_parts; ++p) {
+                int start = pc->parts[p];
+                int end = p < pc->num_parts - 1 ? pc->parts[p + 1] : pc->num_points;
+                // drop the closing point of the ring
+                if (end - start > 1 && pts[end - 1].x == pts[start].x && pts[end - 1].y == pts[start].y) {
+                    end -= 1;
+                }
+                int ring_size = end - start;
+                for (int k = 0; k < ring_size; ++k) {
+                    int a = start + k;
+                    if (is_queen) {
+                        AddItem(poly, a, a, pts[a], buckets);
+                    } else if (ring_size > 1) {
+                        int b = start + (k + 1) % ring_size;
+                        if (same_point(pts[a], pts[b], 0)) continue;
+                        if (threshold > 0) {
+                            // anchor the edge at both end points: matched edges could be
+                            // stored in different orientations
+                            AddItem(poly, a, b, pts[a], buckets);
+                            AddItem(poly, b, a, pts[b], buckets);
+                        } else {
+                            if (point_less(pts[b], pts[a])) std::swap(a, b);
+                            ContigItem item = {0, poly, a, b, 0};
+                            item.key = hash_point(pts[a]) ^ mix64(hash_point(pts[b]));
+                            buckets[Shard(item.key)].push_back(item);
+                        }
+                    }
+                }
+            }
+        }
+
+        // find the pairs of polygons that share a vertex/edge in one shard. If
+        // lengths is not null, also store the length of each shared edge (rook)
+        void MatchShard(std::vector<ContigItem>& items, std::vector<std::pair<int, int> >& pairs,
+                        std::vector<double>* lengths) const
+        {
+            std::sort(items.begin(), items.end());
+            size_t run_start = 0;
+            while (run_start < items.size()) {
+                size_t run_end = run_start + 1;
+                while (run_end < items.size() && items[run_end].key == items[run_start].key) {
+                    ++run_end;
+                }
+                // items in a run are sorted by polygon: nothing to pair if all
+                // of them are from the same polygon
+                if (items[run_start].poly != items[run_end - 1].poly) {
+                    for (size_t i = run_start; i < run_end; ++i) {
+                        const ContigItem& a = items[i];
+                        for (size_t j = i + 1; j < run_end; ++j) {
+                            const ContigItem& b = items[j];
+                            if (a.poly == b.poly) continue;
+                            if ((a.flags & GHOST_FLAG) && (b.flags & GHOST_FLAG)) continue;
+                            if (IsMatch(a, b)) {
+                                pairs.push_back(std::make_pair(a.poly, b.poly));
+                                if (lengths) lengths->push_back(EdgeLength(a));
+                            }
+                        }
+                    }
+                }
+                run_start = run_end;
+            }
+        }
+
+    protected:
+        const gda::MainMap& main_map;
+        bool is_queen;
+        double threshold;
+        int n_shards;
+
+        int Shard(uint64_t key) const
+        {
+            return (int)((key >> 32) % (uint64_t)n_shards);
+        }
+
+        const gda::Point& GetPoint(int poly, int pt) const
+        {
+            return ((gda::PolygonContents*)main_map.records[poly])->points[pt];
+        }
+
+        void AddItem(int poly, int pt, int pt2, const gda::Point& anchor,
+                     std::vector<std::vector<ContigItem> >& buckets) const
+        {
+            ContigItem item = {0, poly, pt, pt2, 0};
+            if (threshold <= 0) {
+                item.key = hash_point(anchor);
+                buckets[Shard(item.key)].push_back(item);
+                return;
+            }
+            int64_t cx = (int64_t)std::floor(anchor.x / threshold);
+            int64_t cy = (int64_t)std::floor(anchor.y / threshold);
+            item.key = hash_cell(cx, cy);
+            buckets[Shard(item.key)].push_back(item);
+
+            // copy to half of the 8 adjacent cells: every pair of adjacent
+            // cells is then compared exactly once
+            const int dx[4] = {1, -1, 0, 1};
+            const int dy[4] = {0, 1, 1, 1};
+            item.flags = GHOST_FLAG;
+            for (int d = 0; d < 4; ++d) {
+                item.key = hash_cell(cx + dx[d], cy + dy[d]);
+                buckets[Shard(item.key)].push_back(item);
+            }
+        }
+
+        double EdgeLength(const ContigItem& item) const
+        {
+            const gda::Point& p = GetPoint(item.poly, item.pt);
+            const gda::Point& q = GetPoint(item.poly, item.pt2);
+            double len = std::sqrt((p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y));
+            // with a threshold, every edge is hashed at both end points, and a
+            // shared edge is matched once from each
+            return threshold > 0 ? len / 2 : len;
+        }
+
+        bool IsMatch(const ContigItem& a, const ContigItem& b) const
+        {
+            // hash collisions are possible, so always compare the coordinates
+            if (!same_point(GetPoint(a.poly, a.pt), GetPoint(b.poly, b.pt), threshold)) {
+                return false;
+            }
+            if (is_queen) {
+                return true;
+            }
+            return same_point(GetPoint(a.poly, a.pt2), GetPoint(b.poly, b.pt2), threshold);
+        }
+    };
+
+    double max_abs_coordinate(const gda::MainMap& main_map)
+    {
+        double max_abs = 0;
+        max_abs = std::max(max_abs, std::fabs(main_map.bbox_x_min));
+        max_abs = std::max(max_abs, std::fabs(main_map.bbox_x_max));
+        max_abs = std::max(max_abs, std::fabs(main_map.bbox_y_min));
+        max_abs = std::max(max_abs, std::fabs(main_map.bbox_y_max));
+        return max_abs;
+    }
+
+    WeightsCSR polys_to_contig_csr(const gda::MainMap& main_map, bool is_queen, double precision_threshold,
+                                   bool with_lengths, int n_threads)
+    {
+        int num_obs = (int)main_map.records.size();
+        if (n_threads < 1) n_threads = 1;
+
+        // a threshold below the resolution of double is the same as no threshold,
+        // and would overflow the grid cell index
+        if (precision_threshold > 0 && max_abs_coordinate(main_map) / precision_threshold > 4.0e15) {
+            precision_threshold = 0;
+        }
+
+        int n_shards = n_threads * SHARDS_PER_THREAD;
+        ContigHasher hasher(main_map, is_queen, precision_threshold, n_shards);
+
+        // pass 1: each thread hashes a block of polygons into its own buckets
+        std::vector<std::vector<std::vector<ContigItem> > > buckets(n_threads);
+        gda_parallel_for(num_obs, n_threads, [&](size_t start, size_t end, int t) {
+            buckets[t].resize(n_shards);
+            for (size_t i = start; i < end; ++i) {
+                hasher.AddPolygon((int)i, buckets[t]);
+            }
+        });
+
+        // pass 2: each thread owns a set of shards, and pairs the polygons in them
+        std::vector<std::vector<std::pair<int, int> > > pairs(n_shards);
+        std::vector<std::vector<double> > lengths(with_lengths ? n_shards : 0);
+        gda_parallel_for(n_shards, n_threads, [&](size_t start, size_t end, int) {
+            std::vector<ContigItem> items;
+            for (size_t s = start; s < end; ++s) {
+                items.clear();
+                for (size_t t = 0; t < buckets.size(); ++t) {
+                    if (buckets[t].empty()) continue;
+                    std::vector<ContigItem>& b = buckets[t][s];
+                    items.insert(items.end(), b.begin(), b.end());
+                    std::vector<ContigItem>().swap(b);
+                }
+                hasher.MatchShard(items, pairs[s], with_lengths ? &lengths[s] : 0);
+            }
+        });
+
+        // pass 3: emit neighbors directly into CSR (summing the lengths of all
+        // edges shared by the same two polygons)
+        return CSRFromWeightedPairs(num_obs, pairs, lengths, n_threads);
+    }
+}
+
+WeightsCSR PolysToContigCSR(const gda::MainMap& main_map, bool is_queen, double precision_threshold,
+                            int n_threads)
+{
+    return polys_to_contig_csr(main_map, is_queen, precision_threshold, false, n_threads);
+}
+
+WeightsCSR PolysToBoundaryLengthCSR(const gda::MainMap& main_map, double precision_threshold, int n_threads)
+{
+    return polys_to_contig_csr(main_map, false, precision_threshold, true, n_threads);
+}
+
+WeightsCSR HigherOrderContiguity(const WeightsCSR& first_order, unsigned int order, bool include_lower_order,
+                                 int n_threads)
+{
+    int num_obs = first_order.num_obs;
+    if (n_threads < 1) n_threads = 1;
+    if (order <= 1) return first_order;
+
+    // each thread expands a block of rows, the blocks are joined in order
+    std::vector<std::vector<long> > block_nbrs(n_threads);
+    std::vector<size_t> row_sizes(num_obs, 0);
+
+    gda_parallel_for(num_obs, n_threads, [&](size_t start, size_t end, int t) {
+        std::vector<uint64_t> visited((num_obs + 63) / 64, 0);
+        std::vector<long> frontier, next_frontier, touched;
+        std::vector<long>& out = block_nbrs[t];
+
+        for (size_t i = start; i < end; ++i) {
+            size_t row_start = out.size();
+            frontier.assign(1, (long)i);
+            touched.assign(1, (long)i);
+            visited[i >> 6] |= (uint64_t)1 << (i & 63);
+
+            for (unsigned int depth = 1; depth <= order && !frontier.empty(); ++depth) {
+                next_frontier.clear();
+                for (size_t f = 0; f < frontier.size(); ++f) {
+                    long u = frontier[f];
+                    for (size_t k = first_order.offsets[u]; k < first_order.offsets[u + 1]; ++k) {
+                        long v = first_order.nbrs[k];
+                        uint64_t bit = (uint64_t)1 << (v & 63);
+                        if (visited[v >> 6] & bit) continue;
+                        visited[v >> 6] |= bit;
+                        touched.push_back(v);
+                        next_frontier.push_back(v);
+                    }
+                }
+                if (depth == order || include_lower_order) {
+                    out.insert(out.end(), next_frontier.begin(), next_frontier.end());
+                }
+                frontier.swap(next_frontier);
+            }
+            // reset only the bits set by this row
+            for (size_t k = 0; k < touched.size(); ++k) {
+                visited[touched[k] >> 6] = 0;
+            }
+            std::sort(out.begin() + row_start, out.end());
+            row_sizes[i] = out.size() - row_start;
+        }
+    });
+
+    WeightsCSR csr;
+    csr.num_obs = num_obs;
+    csr.is_symmetric = first_order.is_symmetric;
+    csr.offsets.resize(num_obs + 1, 0);
+    for (int i = 0; i < num_obs; ++i) {
+        csr.offsets[i + 1] = csr.offsets[i] + row_sizes[i];
+    }
+    csr.nbrs.reserve(csr.offsets[num_obs]);
+    for (int t = 0; t < n_threads; ++t) {
+        csr.nbrs.insert(csr.nbrs.end(), block_nbrs[t].begin(), block_nbrs[t].end());
+        std::vector<long>().swap(block_nbrs[t]);
+    }
+    return csr;
+}
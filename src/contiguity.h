@@ -0,0 +1,52 @@
+#ifndef JSGEODA_CONTIGUITY_H
+#define JSGEODA_CONTIGUITY_H
+
+#include "../libgeoda_src/geofeature.h"
+#include "weights_csr.h"
+
+/**
+ * Create first-order contiguity weights of a polygon map.
+ *
+ * Queen: two polygons are neighbors if they share a vertex. The vertices of all
+ * polygons are hashed into sharded tables (one shard is processed by one
+ * thread), and the polygons found in the same hash slot are paired.
+ *
+ * Rook: two polygons are neighbors if they share an edge. The undirected edges
+ * (pairs of consecutive vertices) are hashed the same way.
+ *
+ * When precision_threshold > 0, two vertices are the same if both |dx| and |dy|
+ * are not larger than precision_threshold. In that case the vertices are
+ * snapped to grid cells of precision_threshold size, and each vertex is also
+ * matched against vertices in the adjacent cells, so no pair within the
+ * threshold is missed.
+ *
+ * The result is symmetric, with the neighbors of each row sorted by id. Null
+ * shapes have no neighbors.
+ */
+WeightsCSR PolysToContigCSR(const gda::MainMap& main_map, bool is_queen, double precision_threshold,
+                            int n_threads);
+
+/**
+ * Create rook weights of a polygon map, weighted by the length of the shared
+ * border: the lengths of the edges matched in the rook pass are summed for
+ * each pair of polygons, in the same pass. The lengths are in map units.
+ *
+ * Only edges present in both polygons are counted (as in rook contiguity): a
+ * border where one polygon has an extra vertex that the other does not have
+ * is missed.
+ */
+WeightsCSR PolysToBoundaryLengthCSR(const gda::MainMap& main_map, double precision_threshold, int n_threads);
+
+/**
+ * Create higher-order contiguity weights from first-order contiguity weights.
+ *
+ * The neighbors of order k are the observations whose shortest path to i in the
+ * first-order graph has exactly k steps (or 1..k steps if include_lower_order).
+ * They are found by a breadth-first expansion of the frontier from every
+ * observation, in parallel over observations; each thread keeps its own
+ * visited bitset.
+ */
+WeightsCSR HigherOrderContiguity(const WeightsCSR& first_order, unsigned int order, bool include_lower_order,
+                                 int n_threads);
+
+#endif //JSGEODA_CONTIGUITY_H
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+#include "../libgeoda_src/weights/VoronoiUtils.h"
+#include "knn_weights.h"
+#include "sphere.h"
+#include "distance_mst.h"
+
+namespace {
+
+    struct MSTEdge {
+        double dist;
+        int from;
+        int to;
+
+        bool operator<(const MSTEdge& o) const {
+            return dist < o.dist || (dist == o.dist && (from < o.from || (from == o.from && to < o.to)));
+        }
+    };
+
+    class UnionFind {
+    public:
+        explicit UnionFind(int n) : parent(n) { for (int i = 0; i < n; ++i) parent[i] = i; }
+
+        int Find(int i)
+        {
+            while (parent[i] != i) {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+            }
+            return i;
+        }
+
+        bool Union(int a, int b)
+        {
+            a = Find(a);
+            b = Find(b);
+            if (a == b) return false;
+            parent[std::max(a, b)] = std::min(a, b);
+            return true;
+        }
+
+    protected:
+        std::vector<int> parent;
+    };
+
+    class PointDistance {
+    public:
+        PointDistance(const std::vector<double>& x, const std::vector<double>& y, bool is_arc, bool is_mile)
+        : x(x), y(y), is_arc(is_arc), is_mile(is_mile)
+        {
+            if (is_arc) coords = LonLatToUnitVectors(x, y);
+        }
+
+        double operator()(int i, int j) const
+        {
+            if (is_arc) {
+                double d2 = 0;
+                for (int d = 0; d < 3; ++d) {
+                    double diff = coords[i * 3 + d] - coords[j * 3 + d];
+                    d2 += diff * diff;
+                }
+                return ChordToArcDistance(std::sqrt(d2), is_mile);
+            }
+            double dx = x[i] - x[j], dy = y[i] - y[j];
+            return std::sqrt(dx * dx + dy * dy);
+        }
+
+    protected:
+        const std::vector<double>& x;
+        const std::vector<double>& y;
+        bool is_arc;
+        bool is_mile;
+        std::vector<double> coords;
+    };
+
+    // join the components left by Kruskal with a dense Prim search over the
+    // component roots' members: O(n^2), only used as a fallback
+    void join_components(int n, const PointDistance& distance, UnionFind& uf, std::vector<MSTEdge>& mst)
+    {
+        std::vector<int> comp(n);
+        for (int i = 0; i < n; ++i) comp[i] = uf.Find(i);
+        std::vector<bool> in_tree(n, false);
+        std::vector<double> best(n, HUGE_VAL);
+        std::vector<int> best_from(n, -1);
+
+        // grow from the component of point 0: adding a point adds its whole
+        // component at distance 0
+        std::vector<int> members;
+        int root = comp[0];
+        for (int i = 0; i < n; ++i) if (comp[i] == root) members.push_back(i);
+        while (!members.empty()) {
+            for (size_t m = 0; m < members.size(); ++m) in_tree[members[m]] = true;
+            for (size_t m = 0; m < members.size(); ++m) {
+                int u = members[m];
+                for (int v = 0; v < n; ++v) {
+                    if (in_tree[v]) continue;
+                    double d = distance(u, v);
+                    if (d < best[v]) {
+                        best[v] = d;
+                        best_from[v] = u;
+                    }
+                }
+            }
+            int next = -1;
+            for (int v = 0; v < n; ++v) {
+                if (!in_tree[v] && (next < 0 || best[v] < best[next])) next = v;
+            }
+            members.clear();
+            if (next < 0) break;
+            MSTEdge e = {best[next], std::min(best_from[next], next), std::max(best_from[next], next)};
+            mst.push_back(e);
+            uf.Union(best_from[next], next);
+            for (int i = 0; i < n; ++i) if (comp[i] == comp[next]) members.push_back(i);
+        }
+    }
+}
+
+DistanceMST BuildDistanceMST(const std::vector<double>& x, const std::vector<double>& y, bool is_arc,
+                             bool is_mile)
+{
+    DistanceMST result;
+    int num_obs = (int)x.size();
+    result.num_obs = num_obs;
+    if (num_obs < 2) return result;
+
+    PointDistance distance(x, y, is_arc, is_mile);
+    std::vector<MSTEdge> candidates;
+
+    // merge coincident points: they are joined to the first point at the same
+    // location by an edge of length 0
+    std::vector<std::pair<std::pair<double, double>, int> > sorted(num_obs);
+    for (int i = 0; i < num_obs; ++i) sorted[i] = std::make_pair(std::make_pair(x[i], y[i]), i);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int> unique_ids;
+    std::vector<double> ux, uy;
+    for (int k = 0; k < num_obs; ++k) {
+        int i = sorted[k].second;
+        if (k > 0 && sorted[k].first == sorted[k - 1].first) {
+            MSTEdge e = {0, std::min(unique_ids.back(), i), std::max(unique_ids.back(), i)};
+            candidates.push_back(e);
+            continue;
+        }
+        unique_ids.push_back(i);
+        ux.push_back(x[i]);
+        uy.push_back(y[i]);
+    }
+
+    // Delaunay edges: the points whose Voronoi cells share an edge
+    if (unique_ids.size() > 1) {
+        std::vector<std::set<int> > nbr_map;
+        if (Gda::VoronoiUtils::PointsToContiguity(ux, uy, false, nbr_map)) {
+            for (size_t a = 0; a < nbr_map.size(); ++a) {
+                std::set<int>::const_iterator it;
+                for (it = nbr_map[a].begin(); it != nbr_map[a].end(); ++it) {
+                    if ((int)a >= *it) continue;
+                    int i = unique_ids[a], j = unique_ids[*it];
+                    MSTEdge e = {distance(i, j), std::min(i, j), std::max(i, j)};
+                    candidates.push_back(e);
+                }
+            }
+        }
+        // nearest-neighbor edges: exact for both planar and arc distances
+        KnnNeighbors knn = is_arc ? KnnSearchAllArc(ux, uy, 1, is_mile, 1) : KnnSearchAll(ux, uy, 1, 1);
+        for (size_t a = 0; a < unique_ids.size(); ++a) {
+            int i = unique_ids[a], j = unique_ids[knn.nbrs[a]];
+            MSTEdge e = {knn.dists[a], std::min(i, j), std::max(i, j)};
+            candidates.push_back(e);
+        }
+    }
+
+    // Kruskal
+    std::sort(candidates.begin(), candidates.end());
+    UnionFind uf(num_obs);
+    std::vector<MSTEdge> mst;
+    mst.reserve(num_obs - 1);
+    for (size_t e = 0; e < candidates.size() && (int)mst.size() < num_obs - 1; ++e) {
+        if (uf.Union(candidates[e].from, candidates[e].to)) {
+            mst.push_back(candidates[e]);
+        }
+    }
+    if ((int)mst.size() < num_obs - 1) {
+        join_components(num_obs, distance, uf, mst);
+        std::sort(mst.begin(), mst.end());
+    }
+
+    // the shortest MST edge at each point is its nearest-neighbor distance
+    std::vector<double> nn_dist(num_obs, HUGE_VAL);
+    for (size_t e = 0; e < mst.size(); ++e) {
+        result.from.push_back(mst[e].from);
+        result.to.push_back(mst[e].to);
+        result.dist.push_back(mst[e].dist);
+        nn_dist[mst[e].from] = std::min(nn_dist[mst[e].from], mst[e].dist);
+        nn_dist[mst[e].to] = std::min(nn_dist[mst[e].to], mst[e].dist);
+        result.max_edge = std::max(result.max_edge, mst[e].dist);
+    }
+    for (int i = 0; i < num_obs; ++i) {
+        if (nn_dist[i] < HUGE_VAL) result.max_nn_dist = std::max(result.max_nn_dist, nn_dist[i]);
+    }
+    return result;
+}
@@ -0,0 +1,47 @@
+#ifndef JSGEODA_DISTANCE_MST_H
+#define JSGEODA_DISTANCE_MST_H
+
+#include <vector>
+
+/**
+ * DistanceMST
+ *
+ * Minimum spanning tree of the points by Euclidean (or great-circle) distance.
+ * Edge e connects from[e] and to[e] with length dist[e]; the edges are sorted
+ * by length.
+ */
+struct DistanceMST {
+    int num_obs;
+    std::vector<int> from;
+    std::vector<int> to;
+    std::vector<double> dist;
+
+    // largest nearest-neighbor distance: the smallest threshold that gives
+    // every observation at least one neighbor
+    double max_nn_dist;
+
+    // longest MST edge: the smallest threshold that connects all observations
+    double max_edge;
+
+    DistanceMST() : num_obs(0), max_nn_dist(0), max_edge(0) {}
+};
+
+/**
+ * Build the minimum spanning tree of the points (x, y), or (lon, lat) in
+ * degrees if is_arc (distances in km, or miles if is_mile).
+ *
+ * The MST is a subgraph of the Delaunay triangulation, which is read from the
+ * Voronoi diagram of the points (Gda::VoronoiUtils): so only O(n) candidate
+ * edges are sorted, instead of scanning all pairs. The nearest-neighbor edges
+ * are always added as candidates, and if the candidates do not connect all
+ * points (e.g. the Voronoi diagram could not be built), the remaining
+ * components are joined by a dense Prim search.
+ *
+ * Coincident points are merged before the triangulation and joined by edges of
+ * length 0. With is_arc, the triangulation is done on (lon, lat), and the edges
+ * are weighted by great-circle distance.
+ */
+DistanceMST BuildDistanceMST(const std::vector<double>& x, const std::vector<double>& y, bool is_arc,
+                             bool is_mile);
+
+#endif //JSGEODA_DISTANCE_MST_H
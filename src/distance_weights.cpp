@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+#include "hilbert.h"
+#include "kdtree.h"
+#include "parallel.h"
+#include "sphere.h"
+#include "distance_weights.h"
+
+namespace {
+
+    // more cells than this per axis would overflow the cell keys: the cells are
+    // enlarged instead, which only adds candidates to check
+    const double MAX_CELLS_PER_AXIS = 1073741824.0; // 2^30
+
+    /**
+     * Points bucketed into a uniform grid. The points are sorted by cell
+     * (row-major), so the 3 cells (cx-1..cx+1, cy) of a grid row are one
+     * contiguous range of the sorted points, and their coordinates are copied
+     * in that order to be scanned sequentially.
+     */
+    class DistanceGrid {
+    public:
+        DistanceGrid(const std::vector<double>& x, const std::vector<double>& y, double dist_thres)
+        : r2(dist_thres < 0 ? -1 : dist_thres * dist_thres)
+        {
+            int n = (int)x.size();
+            x_min = HUGE_VAL, y_min = HUGE_VAL;
+            double x_max = -HUGE_VAL, y_max = -HUGE_VAL;
+            for (int i = 0; i < n; ++i) {
+                x_min = std::min(x_min, x[i]);
+                x_max = std::max(x_max, x[i]);
+                y_min = std::min(y_min, y[i]);
+                y_max = std::max(y_max, y[i]);
+            }
+            double extent = n > 0 ? std::max(x_max - x_min, y_max - y_min) : 0;
+            cell_size = std::max(dist_thres, extent / MAX_CELLS_PER_AXIS);
+            if (!(cell_size > 0)) cell_size = 1.0;
+
+            std::vector<std::pair<uint64_t, int> > point_keys(n);
+            for (int i = 0; i < n; ++i) {
+                // points without valid coordinates are sorted last, and never matched
+                bool is_valid = std::isfinite(x[i]) && std::isfinite(y[i]);
+                point_keys[i].first = is_valid ? CellKey(CellX(x[i]), CellY(y[i])) : INVALID_KEY;
+                point_keys[i].second = i;
+            }
+            std::sort(point_keys.begin(), point_keys.end());
+            keys.resize(n);
+            order.resize(n);
+            sx.resize(n);
+            sy.resize(n);
+            pos_of.resize(n);
+            for (int p = 0; p < n; ++p) {
+                int i = point_keys[p].second;
+                keys[p] = point_keys[p].first;
+                order[p] = i;
+                sx[p] = x[i];
+                sy[p] = y[i];
+                pos_of[i] = p;
+            }
+        }
+
+        // the rows sorted by cell: consecutive queries search the same cells
+        const std::vector<int>& QueryOrder() const { return order; }
+
+        // call func(j, d2) for every neighbor j of point i
+        template <class Func>
+        void ForEachNeighbor(int i, Func func) const
+        {
+            int pos = pos_of[i];
+            if (keys[pos] == INVALID_KEY) return;
+            double qx = sx[pos], qy = sy[pos];
+            int64_t cx = (int64_t)(keys[pos] & 0xffffffff), cy = (int64_t)(keys[pos] >> 32);
+            for (int64_t row = cy - 1; row <= cy + 1; ++row) {
+                if (row < 0) continue;
+                size_t lo = std::lower_bound(keys.begin(), keys.end(), CellKey(std::max<int64_t>(cx - 1, 0), row))
+                            - keys.begin();
+                size_t hi = std::upper_bound(keys.begin(), keys.end(), CellKey(cx + 1, row)) - keys.begin();
+                for (size_t p = lo; p < hi; ++p) {
+                    double dx = qx - sx[p], dy = qy - sy[p];
+                    double d2 = dx * dx + dy * dy;
+                    if (d2 <= r2 && (int)p != pos) func(order[p], d2);
+                }
+            }
+        }
+
+        double ToDistance(double d2) const { return std::sqrt(d2); }
+
+    protected:
+        static const uint64_t INVALID_KEY = UINT64_MAX;
+
+        double r2;
+        double x_min;
+        double y_min;
+        double cell_size;
+        std::vector<uint64_t> keys; // sorted cell keys
+        std::vector<int> order;     // point index of each sorted key
+        std::vector<int> pos_of;    // sorted position of each point
+        std::vector<double> sx;     // coordinates in sorted order
+        std::vector<double> sy;
+
+        int64_t CellX(double v) const { return (int64_t)std::floor((v - x_min) / cell_size); }
+
+        int64_t CellY(double v) const { return (int64_t)std::floor((v - y_min) / cell_size); }
+
+        static uint64_t CellKey(int64_t cx, int64_t cy) { return ((uint64_t)cy << 32) | (uint64_t)cx; }
+    };
+
+    /**
+     * Build a symmetric CSR in two parallel passes over the rows: count the
+     * neighbors, then fill the rows at their final offsets.
+     * search.ForEachNeighbor(i, func) calls func(j, d2) for every neighbor j
+     * of i, search.ToDistance(d2) returns the reported distance, and the rows
+     * are visited in search.QueryOrder().
+     */
+    template <class Search>
+    WeightsCSR two_pass_csr(int num_obs, int n_threads, const Search& search)
+    {
+        WeightsCSR csr;
+        csr.num_obs = num_obs;
+        csr.is_symmetric = true;
+        csr.offsets.resize(num_obs + 1, 0);
+
+        const std::vector<int>& query_order = search.QueryOrder();
+        gda_parallel_for(num_obs, n_threads, [&](size_t start, size_t end, int) {
+            for (size_t p = start; p < end; ++p) {
+                int i = query_order[p];
+                size_t cnt = 0;
+                search.ForEachNeighbor(i, [&](int, double) { ++cnt; });
+                csr.offsets[i + 1] = cnt;
+            }
+        });
+        for (int i = 0; i < num_obs; ++i) {
+            csr.offsets[i + 1] += csr.offsets[i];
+        }
+
+        csr.nbrs.resize(csr.offsets[num_obs]);
+        csr.weights.resize(csr.offsets[num_obs]);
+        gda_parallel_for(num_obs, n_threads, [&](size_t start, size_t end, int) {
+            std::vector<std::pair<long, double> > row;
+            for (size_t p = start; p < end; ++p) {
+                int i = query_order[p];
+                row.clear();
+                search.ForEachNeighbor(i, [&](int j, double d2) {
+                    row.push_back(std::make_pair((long)j, d2));
+                });
+                std::sort(row.begin(), row.end());
+                size_t pos = csr.offsets[i];
+                for (size_t k = 0; k < row.size(); ++k, ++pos) {
+                    csr.nbrs[pos] = row[k].first;
+                    csr.weights[pos] = search.ToDistance(row[k].second);
+                }
+            }
+        });
+        return csr;
+    }
+
+    template <class Search>
+    size_t count_pairs(int num_obs, int n_threads, const Search& search)
+    {
+        std::vector<size_t> counts(n_threads > 0 ? n_threads : 1, 0);
+        const std::vector<int>& query_order = search.QueryOrder();
+        gda_parallel_for(num_obs, n_threads, [&](size_t start, size_t end, int t) {
+            size_t cnt = 0;
+            for (size_t p = start; p < end; ++p) {
+                search.ForEachNeighbor(query_order[p], [&](int, double) { ++cnt; });
+            }
+            counts[t] = cnt;
+        });
+        size_t total = 0;
+        for (size_t t = 0; t < counts.size(); ++t) total += counts[t];
+        return total;
+    }
+
+    // fixed-radius search on the unit sphere
+    class ArcSearch {
+    public:
+        ArcSearch(const std::vector<double>& lon, const std::vector<double>& lat, double dist_thres, bool is_mile)
+        : coords(LonLatToUnitVectors(lon, lat)), tree(coords), order(HilbertOrder(lon, lat)), is_mile(is_mile)
+        {
+            double chord = ArcDistanceToChord(dist_thres, is_mile);
+            r2 = dist_thres < 0 ? -1 : chord * chord;
+        }
+
+        template <class Func>
+        void ForEachNeighbor(int i, Func func) const
+        {
+            tree.RadiusSearch(&coords[(size_t)i * 3], r2, i, func);
+        }
+
+        const std::vector<int>& QueryOrder() const { return order; }
+
+        double ToDistance(double d2) const { return ChordToArcDistance(std::sqrt(d2), is_mile); }
+
+    protected:
+        std::vector<double> coords;
+        KdTree<3> tree;
+        std::vector<int> order;
+        bool is_mile;
+        double r2;
+    };
+}
+
+WeightsCSR DistanceBandCSR(const std::vector<double>& x, const std::vector<double>& y, double dist_thres,
+                           int n_threads)
+{
+    DistanceGrid grid(x, y, dist_thres);
+    return two_pass_csr((int)x.size(), n_threads, grid);
+}
+
+size_t CountDistanceBand(const std::vector<double>& x, const std::vector<double>& y, double dist_thres,
+                         int n_threads)
+{
+    DistanceGrid grid(x, y, dist_thres);
+    return count_pairs((int)x.size(), n_threads, grid);
+}
+
+WeightsCSR DistanceBandArc(const std::vector<double>& lon, const std::vector<double>& lat, double dist_thres,
+                           bool is_mile, int n_threads)
+{
+    ArcSearch search(lon, lat, dist_thres, is_mile);
+    return two_pass_csr((int)lon.size(), n_threads, search);
+}
+
+size_t CountDistanceBandArc(const std::vector<double>& lon, const std::vector<double>& lat, double dist_thres,
+                            bool is_mile, int n_threads)
+{
+    ArcSearch search(lon, lat, dist_thres, is_mile);
+    return count_pairs((int)lon.size(), n_threads, search);
+}
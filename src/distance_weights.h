@@ -0,0 +1,44 @@
+#ifndef JSGEODA_DISTANCE_WEIGHTS_H
+#define JSGEODA_DISTANCE_WEIGHTS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "weights_csr.h"
+
+/**
+ * Find all pairs of points (x, y) within Euclidean distance dist_thres.
+ *
+ * The points are bucketed into a uniform grid with cells of dist_thres size,
+ * so the neighbors of a point are all in the 3x3 cells around it. The rows are
+ * searched in parallel twice: the first pass counts the neighbors of each row
+ * to size the CSR exactly, the second pass fills it in place.
+ *
+ * The result is symmetric, the neighbors of each row are sorted by id, and
+ * csr.weights holds the distances (see CSRDistancesToWeights()).
+ */
+WeightsCSR DistanceBandCSR(const std::vector<double>& x, const std::vector<double>& y, double dist_thres,
+                           int n_threads);
+
+/**
+ * Number of non-zeros (neighbor pairs, counted in both directions) that
+ * DistanceBandCSR() would create, without building the weights. Use it to
+ * reject a threshold that would need too much memory.
+ */
+size_t CountDistanceBand(const std::vector<double>& x, const std::vector<double>& y, double dist_thres,
+                         int n_threads);
+
+/**
+ * Find all pairs of points (lon, lat) within great-circle distance dist_thres
+ * (in km, or miles if is_mile). The points are converted to 3D unit vectors
+ * and the threshold to a chord, so the search runs in a 3D kd-tree and is exact.
+ * Same two-pass layout and result as DistanceBandCSR(), with arc distances in
+ * csr.weights.
+ */
+WeightsCSR DistanceBandArc(const std::vector<double>& lon, const std::vector<double>& lat, double dist_thres,
+                           bool is_mile, int n_threads);
+
+size_t CountDistanceBandArc(const std::vector<double>& lon, const std::vector<double>& lat, double dist_thres,
+                            bool is_mile, int n_threads);
+
+#endif //JSGEODA_DISTANCE_WEIGHTS_H
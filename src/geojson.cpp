@@ -6,11 +6,18 @@
 
 #include "../libgeoda_src/shape/centroid.h"
 #include "../libgeoda_src/gda_weights.h"
+#include "contiguity.h"
+#include "distance_weights.h"
+#include "kernel_weights.h"
+#include "knn_weights.h"
+#include "hilbert.h"
+#include "parallel.h"
 #include "geojson.h"
 
 using error = std::runtime_error;
 
 GdaGeojson::GdaGeojson()
+: use_spatial_order(false), use_compact_weights(false), use_implicit_kernels(false), knn_search_k(0)
 {
 
 }
@@ -58,13 +65,7 @@ GdaGeojson::GdaGeojson(const char* file_name, const char* in_content)
 
 GdaGeojson::~GdaGeojson()
 {
-    // free memory
-    std::map<std::string, GeoDaWeight*>::iterator it;
-    for (it = weights_dict.begin(); it != weights_dict.end(); ++it) {
-        delete it->second;
-    }
-    weights_dict.clear();
-
+    // free memory (the weights are freed by weights_cache)
     for (size_t i=0; i<centroids.size(); ++i) {
         if (centroids[i]) {
             delete centroids[i];
@@ -137,56 +138,171 @@ const std::vector<gda::PointContents*>& GdaGeojson::GetCentroids()
 }
 
 
+void GdaGeojson::getCentroidXY(std::vector<double>& x, std::vector<double>& y)
+{
+    const std::vector<gda::PointContents*>& cents = this->GetCentroids();
+    x.resize(cents.size());
+    y.resize(cents.size());
+    for (size_t i=0; i<cents.size(); ++i) {
+        x[i] = cents[i]->x;
+        y[i] = cents[i]->y;
+    }
+}
+
+WeightsCSR GdaGeojson::createDistanceBand(double dist_thres, bool is_arc, bool is_mile)
+{
+    std::vector<double> x, y;
+    this->getCentroidXY(x, y);
+    if (is_arc) {
+        return DistanceBandArc(x, y, dist_thres, is_mile, gda_num_threads());
+    }
+    return DistanceBandCSR(x, y, dist_thres, gda_num_threads());
+}
+
+size_t GdaGeojson::CountDistanceNeighbors(double dist_thres, bool is_arc, bool is_mile)
+{
+    std::vector<double> x, y;
+    this->getCentroidXY(x, y);
+    if (is_arc) {
+        return CountDistanceBandArc(x, y, dist_thres, is_mile, gda_num_threads());
+    }
+    return CountDistanceBand(x, y, dist_thres, gda_num_threads());
+}
+
+void GdaGeojson::SetSpatialOrder(bool use_hilbert_order)
+{
+    this->use_spatial_order = use_hilbert_order;
+}
+
+const SpatialOrder& GdaGeojson::GetSpatialOrder()
+{
+    static const SpatialOrder file_order;
+    if (!this->use_spatial_order) {
+        return file_order;
+    }
+    if (this->spatial_order.IsEmpty() && this->GetNumObs() > 0) {
+        std::vector<double> x, y;
+        this->getCentroidXY(x, y);
+        this->spatial_order = MakeSpatialOrder(HilbertOrder(x, y));
+    }
+    return this->spatial_order;
+}
+
+const KnnNeighbors& GdaGeojson::getKnnNeighbors(unsigned int k, bool is_arc, bool is_mile)
+{
+    std::stringstream knn_uid;
+    knn_uid << "knn";
+    knn_uid << is_arc;
+    knn_uid << is_mile;
+    std::string knn_uid_str = knn_uid.str();
+
+    // search again only if more neighbors are needed than the cached lists have
+    // (or the lists were evicted)
+    int max_k = std::max(0, this->GetNumObs() - 1);
+    int needed_k = std::min((int)k, max_k);
+    std::map<std::string, KnnNeighbors>::iterator it = this->knn_dict.find(knn_uid_str);
+    if (it == this->knn_dict.end() || it->second.k < needed_k) {
+        unsigned int search_k = std::max(k, this->knn_search_k);
+        std::vector<double> x, y;
+        this->getCentroidXY(x, y);
+        KnnNeighbors& knn = this->knn_dict[knn_uid_str];
+        knn = is_arc ? KnnSearchAllArc(x, y, search_k, is_mile, gda_num_threads())
+                     : KnnSearchAll(x, y, search_k, gda_num_threads());
+        this->weights_cache.SetSideData(knn_uid_str, knn.nbrs.size() * sizeof(int) +
+                                        knn.dists.size() * sizeof(double), [=]() {
+            this->knn_dict.erase(knn_uid_str);
+        });
+        return knn;
+    }
+    this->weights_cache.UseSideData(knn_uid_str);
+    return it->second;
+}
+
+const DistanceMST& GdaGeojson::GetDistanceMST(bool is_arc, bool is_mile)
+{
+    std::stringstream mst_uid;
+    mst_uid << "mst";
+    mst_uid << is_arc;
+    mst_uid << is_mile;
+    std::string mst_uid_str = mst_uid.str();
+
+    std::map<std::string, DistanceMST>::iterator it = this->mst_dict.find(mst_uid_str);
+    if (it == this->mst_dict.end()) {
+        std::vector<double> x, y;
+        this->getCentroidXY(x, y);
+        DistanceMST& mst = this->mst_dict[mst_uid_str];
+        mst = BuildDistanceMST(x, y, is_arc, is_mile);
+        this->weights_cache.SetSideData(mst_uid_str, (mst.from.size() + mst.to.size()) * sizeof(int) +
+                                        mst.dist.size() * sizeof(double), [=]() {
+            this->mst_dict.erase(mst_uid_str);
+        });
+        return mst;
+    }
+    this->weights_cache.UseSideData(mst_uid_str);
+    return it->second;
+}
+
 double GdaGeojson::GetMinDistanceThreshold(bool is_arc, bool is_mile)
 {
-    return gda_min_distthreshold((AbstractGeoDa*)this, is_arc, is_mile);
+    return this->GetDistanceMST(is_arc, is_mile).max_nn_dist;
+}
+
+double GdaGeojson::GetConnectivityThreshold(bool is_arc, bool is_mile)
+{
+    return this->GetDistanceMST(is_arc, is_mile).max_edge;
 }
 
 GeoDaWeight* GdaGeojson::CreateQueenWeights(unsigned int order, 
         bool include_lower_order,
- 	    double precision_threshold)
-{
-    std::stringstream w_uid;
-    w_uid << "w_queen";
-    w_uid << this->file_path;
-    w_uid << order;
-    w_uid << include_lower_order;
-    w_uid << precision_threshold;
-    std::string w_uid_str = w_uid.str();
-    GeoDaWeight* w = 0;
-
-    if (this->weights_dict.find(w_uid_str) != this->weights_dict.end()) {
-        //std::cout << "GdaGeojson::CreateQueenWeights() direct return:" << w_uid_str << std::endl;
-        w = this->weights_dict[w_uid.str()];
-    } else {
-        //std::cout << "GdaGeojson::CreateQueenWeights()" << std::endl;
-        w = gda_queen_weights((AbstractGeoDa*)this, order, include_lower_order, precision_threshold);
-        w->uid = w_uid_str;
-        this->weights_dict[w_uid.str()] = w;
+ 	    double precision_threshold,
+        unsigned int fill_islands_k)
+{
+    WeightsParams params("queen", this->file_path);
+    params.Add("order", order).Add("include_lower_order", include_lower_order)
+          .Add("precision_threshold", precision_threshold);
+    if (fill_islands_k > 0) {
+        // only added if set: the uids of plain contiguity weights do not change
+        params.Add("fill_islands_k", fill_islands_k);
     }
-    return w;
+
+    return this->weights_cache.GetOrCreate(params.GetUid(), [=]() {
+        return this->createContiguityWeights(true, order, include_lower_order, precision_threshold,
+                                             fill_islands_k);
+    });
 }
 
 GeoDaWeight* GdaGeojson::CreateRookWeights(unsigned int order, 
         bool include_lower_order,
- 	    double precision_threshold)
-{
-    std::stringstream w_uid;
-    w_uid << "w_rook";
-    w_uid << this->file_path;
-    w_uid << order;
-    w_uid << include_lower_order;
-    w_uid << precision_threshold;
-    std::string w_uid_str = w_uid.str();
-    GeoDaWeight* w = 0;
-    if (this->weights_dict.find(w_uid_str) != this->weights_dict.end()) {
-        w = this->weights_dict[w_uid.str()];
-    } else {
-        w = gda_rook_weights((AbstractGeoDa*)this, order, include_lower_order, precision_threshold);
-        w->uid = w_uid_str;
-        this->weights_dict[w_uid.str()] = w;
+ 	    double precision_threshold,
+        unsigned int fill_islands_k)
+{
+    WeightsParams params("rook", this->file_path);
+    params.Add("order", order).Add("include_lower_order", include_lower_order)
+          .Add("precision_threshold", precision_threshold);
+    if (fill_islands_k > 0) {
+        // only added if set: the uids of plain contiguity weights do not change
+        params.Add("fill_islands_k", fill_islands_k);
     }
-    return w;
+
+    return this->weights_cache.GetOrCreate(params.GetUid(), [=]() {
+        return this->createContiguityWeights(false, order, include_lower_order, precision_threshold,
+                                             fill_islands_k);
+    });
+}
+
+GeoDaWeight* GdaGeojson::CreateBoundaryLengthWeights(double precision_threshold)
+{
+    WeightsParams params("rook_length", this->file_path);
+    params.Add("precision_threshold", precision_threshold);
+
+    return this->weights_cache.GetOrCreate(params.GetUid(), [=]() -> GeoDaWeight* {
+        if (this->main_map.shape_type != gda::POLYGON) {
+            // points have no borders
+            return 0;
+        }
+        WeightsCSR csr = PolysToBoundaryLengthCSR(this->main_map, precision_threshold, gda_num_threads());
+        return CSRToGeoDaWeight(csr);
+    });
 }
 
 GeoDaWeight* GdaGeojson::CreateKnnWeights(unsigned int k,
@@ -195,33 +311,35 @@ GeoDaWeight* GdaGeojson::CreateKnnWeights(unsigned int k,
                                           bool is_arc,
                                           bool is_mile)
 {
-    std::stringstream w_uid;
-    w_uid << "w_knn";
-    w_uid << this->file_path;
-    w_uid << k;
-    w_uid << power;
-    w_uid << is_inverse;
-    w_uid << is_arc;
-    w_uid << is_mile;
-    std::string w_uid_str = w_uid.str();
-    //std::cout << "CreateKnnWeights()" << w_uid_str << std::endl;
-
-    std::string kernel = "";
-    double bandwidth = 0.0;
-    bool adaptive_bandwidth = false;
-    bool use_kernel_diagonals = false;
-    std::string polyid = "";
-
-    GeoDaWeight* w = 0;
-    if (this->weights_dict.find(w_uid_str) != this->weights_dict.end()) {
-        w = this->weights_dict[w_uid.str()];
-    } else {
-        w = gda_knn_weights((AbstractGeoDa*)this, k, power, is_inverse, is_arc, is_mile, kernel, bandwidth,
-                adaptive_bandwidth, use_kernel_diagonals, polyid);
-        w->uid = w_uid_str;
-        this->weights_dict[w_uid.str()] = w;
+    WeightsParams params("knn", this->file_path);
+    params.Add("k", k).Add("power", power).Add("is_inverse", is_inverse)
+          .Add("is_arc", is_arc).Add("is_mile", is_mile);
+
+    return this->weights_cache.GetOrCreate(params.GetUid(), [=]() {
+        KnnNeighbors knn = KnnPrefix(this->getKnnNeighbors(k, is_arc, is_mile), k);
+        return CSRToGeoDaWeight(KnnToCSR(knn, power, is_inverse));
+    });
+}
+
+std::vector<std::string> GdaGeojson::CreateKnnWeightsSweep(unsigned int k_min,
+                                                           unsigned int k_max,
+                                                           double power,
+                                                           bool is_inverse,
+                                                           bool is_arc,
+                                                           bool is_mile,
+                                                           const std::function<void(GeoDaWeight*)>& on_created)
+{
+    // search once with k_max: every smaller k is a prefix of the same lists,
+    // which are searched with k_max again if evicted during the sweep
+    this->knn_search_k = k_max;
+    std::vector<std::string> w_uids;
+    for (unsigned int k = k_min; k <= k_max; ++k) {
+        GeoDaWeight* w = this->CreateKnnWeights(k, power, is_inverse, is_arc, is_mile);
+        if (on_created) on_created(w);
+        w_uids.push_back(w->uid);
     }
-    return w;
+    this->knn_search_k = 0;
+    return w_uids;
 }
 
 GeoDaWeight* GdaGeojson::CreateDistanceWeights(double dist_thres,
@@ -230,29 +348,15 @@ GeoDaWeight* GdaGeojson::CreateDistanceWeights(double dist_thres,
                                           bool is_arc,
                                           bool is_mile)
 {
-    std::stringstream w_uid;
-    w_uid << "w_dist";
-    w_uid << this->file_path;
-    w_uid << dist_thres;
-    w_uid << power;
-    w_uid << is_inverse;
-    w_uid << is_arc;
-    w_uid << is_mile;
-    std::string w_uid_str = w_uid.str();
-
-    std::string kernel = "";
-    bool use_kernel_diagonals = false;
-
-    GeoDaWeight* w = 0;
-    if (this->weights_dict.find(w_uid_str) != this->weights_dict.end()) {
-        w = this->weights_dict[w_uid.str()];
-    } else {
-        w = gda_distance_weights((AbstractGeoDa*)this, dist_thres, "", power, is_inverse, is_arc, is_mile, kernel,
-                use_kernel_diagonals);
-        w->uid = w_uid_str;
-        this->weights_dict[w_uid.str()] = w;
-    }
-    return w;
+    WeightsParams params("dist", this->file_path);
+    params.Add("dist_thres", dist_thres).Add("power", power).Add("is_inverse", is_inverse)
+          .Add("is_arc", is_arc).Add("is_mile", is_mile);
+
+    return this->weights_cache.GetOrCreate(params.GetUid(), [=]() {
+        WeightsCSR csr = this->createDistanceBand(dist_thres, is_arc, is_mile);
+        CSRDistancesToWeights(csr, power, is_inverse);
+        return CSRToGeoDaWeight(csr);
+    });
 }
 
 GeoDaWeight* GdaGeojson::CreateKernelWeights(double dist_thres,
@@ -261,28 +365,24 @@ GeoDaWeight* GdaGeojson::CreateKernelWeights(double dist_thres,
                                              double power, bool is_inverse,
                                              bool is_arc, bool is_mile)
 {
-    std::stringstream w_uid;
-    w_uid << "w_kernel";
-    w_uid << this->file_path;
-    w_uid << dist_thres;
-    w_uid << kernel;
-    w_uid << use_kernel_diagonals;
-    w_uid << is_arc;
-    w_uid << is_mile;
-    std::string w_uid_str = w_uid.str();
-
-    std::string polyid = "";
-
-    GeoDaWeight* w = 0;
-    if (this->weights_dict.find(w_uid_str) != this->weights_dict.end()) {
-        w = this->weights_dict[w_uid.str()];
-    } else {
-        w = gda_distance_weights((AbstractGeoDa*)this, dist_thres, polyid, power, is_inverse, is_arc, is_mile, kernel,
-                use_kernel_diagonals);
-        w->uid = w_uid_str;
-        this->weights_dict[w_uid.str()] = w;
-    }
-    return w;
+    WeightsParams params("kernel", this->file_path);
+    params.Add("dist_thres", dist_thres).Add("kernel", kernel).Add("use_kernel_diagonals", use_kernel_diagonals)
+          .Add("power", power).Add("is_inverse", is_inverse).Add("is_arc", is_arc).Add("is_mile", is_mile);
+
+    std::string w_uid = params.GetUid();
+    return this->weights_cache.GetOrCreate(w_uid, [=]() -> GeoDaWeight* {
+        KernelType kernel_type;
+        if (ParseKernelType(kernel, kernel_type)) {
+            std::vector<double> bandwidths(1, dist_thres);
+            WeightsCSR csr = this->createDistanceBand(dist_thres, is_arc, is_mile);
+            CSRDistancesToKernel(csr, kernel_type, bandwidths, use_kernel_diagonals);
+            this->setKernelSpec(w_uid, kernel_type, bandwidths, use_kernel_diagonals, is_arc, is_mile);
+            return CSRToGeoDaWeight(csr);
+        }
+        std::string polyid = "";
+        return gda_distance_weights((AbstractGeoDa*)this, dist_thres, polyid, power, is_inverse,
+                is_arc, is_mile, kernel, use_kernel_diagonals);
+    });
 }
 
 GeoDaWeight* GdaGeojson::CreateKernelKnnWeights(unsigned int k,
@@ -292,30 +392,87 @@ GeoDaWeight* GdaGeojson::CreateKernelKnnWeights(unsigned int k,
                                                 double power, bool is_inverse,
                                                 bool is_arc, bool is_mile)
 {
-    std::stringstream w_uid;
-    w_uid << "w_kernel_knn";
-    w_uid << this->file_path;
-    w_uid << k;
-    w_uid << kernel;
-    w_uid << adaptive_bandwidth;
-    w_uid << use_kernel_diagonals;
-    w_uid << is_arc;
-    w_uid << is_mile;
-    std::string w_uid_str = w_uid.str();
-
-    double bandwidth = 0.0;
-    std::string polyid = "";
-
-    GeoDaWeight* w = 0;
-    if (this->weights_dict.find(w_uid_str) != this->weights_dict.end()) {
-        w = this->weights_dict[w_uid.str()];
-    } else {
-        w = gda_knn_weights((AbstractGeoDa*)this, k, power, is_inverse, is_arc, is_mile, kernel, bandwidth,
-                adaptive_bandwidth, use_kernel_diagonals, polyid);
-        w->uid = w_uid_str;
-        this->weights_dict[w_uid.str()] = w;
+    WeightsParams params("kernel_knn", this->file_path);
+    params.Add("k", k).Add("kernel", kernel).Add("adaptive_bandwidth", adaptive_bandwidth)
+          .Add("use_kernel_diagonals", use_kernel_diagonals).Add("power", power).Add("is_inverse", is_inverse)
+          .Add("is_arc", is_arc).Add("is_mile", is_mile);
+
+    std::string w_uid = params.GetUid();
+    return this->weights_cache.GetOrCreate(w_uid, [=]() -> GeoDaWeight* {
+        KernelType kernel_type;
+        if (ParseKernelType(kernel, kernel_type)) {
+            KnnNeighbors knn = KnnPrefix(this->getKnnNeighbors(k, is_arc, is_mile), k);
+            this->setKernelSpec(w_uid, kernel_type, KnnBandwidths(knn, adaptive_bandwidth), use_kernel_diagonals,
+                                is_arc, is_mile);
+            return CSRToGeoDaWeight(KnnToKernelCSR(knn, kernel_type, adaptive_bandwidth, use_kernel_diagonals));
+        }
+        double bandwidth = 0.0;
+        std::string polyid = "";
+        return gda_knn_weights((AbstractGeoDa*)this, k, power, is_inverse, is_arc, is_mile, kernel,
+                bandwidth, adaptive_bandwidth, use_kernel_diagonals, polyid);
+    });
+}
+
+void GdaGeojson::setKernelSpec(const std::string& w_uid, KernelType kernel_type,
+                               const std::vector<double>& bandwidths, bool use_kernel_diagonals, bool is_arc,
+                               bool is_mile)
+{
+    std::vector<double> x, y;
+    this->getCentroidXY(x, y);
+    this->weights_cache.SetKernelSpec(w_uid, MakeKernelSpec(kernel_type, bandwidths, use_kernel_diagonals, x, y,
+                                                            is_arc, is_mile));
+}
+
+LagWeights* GdaGeojson::GetLagWeights(const std::string& w_uid)
+{
+    return this->weights_cache.GetLagWeights(w_uid, this->GetSpatialOrder(), this->use_compact_weights,
+                                             this->use_implicit_kernels);
+}
+
+bool GdaGeojson::FreeWeights(const std::string& w_uid)
+{
+    return this->weights_cache.Free(w_uid);
+}
+
+size_t GdaGeojson::GetWeightsSize(const std::string& w_uid)
+{
+    return this->weights_cache.GetEntrySize(w_uid);
+}
+
+GeoDaWeight* GdaGeojson::createContiguityWeights(bool is_queen, unsigned int order,
+        bool include_lower_order,
+        double precision_threshold,
+        unsigned int fill_islands_k)
+{
+    if (fill_islands_k > 0) {
+        // fill the islands of the contiguity weights, which are created only
+        // once and kept in weights_cache
+        GeoDaWeight* contig_w = is_queen ?
+                this->CreateQueenWeights(order, include_lower_order, precision_threshold) :
+                this->CreateRookWeights(order, include_lower_order, precision_threshold);
+        std::vector<double> x, y;
+        this->getCentroidXY(x, y);
+        return CSRToGeoDaWeight(FillIslandsWithKnn(GeoDaWeightToCSR(contig_w), x, y, fill_islands_k));
+    }
+    if (order > 1) {
+        // expand from the first-order weights, which are created only once and
+        // kept in weights_cache
+        GeoDaWeight* first_order = is_queen ?
+                this->CreateQueenWeights(1, false, precision_threshold) :
+                this->CreateRookWeights(1, false, precision_threshold);
+        WeightsCSR csr = HigherOrderContiguity(GeoDaWeightToCSR(first_order), order, include_lower_order,
+                                               gda_num_threads());
+        return CSRToGeoDaWeight(csr);
+    }
+    if (this->main_map.shape_type != gda::POLYGON) {
+        // points: contiguity from voronoi diagram in libgeoda
+        if (is_queen) {
+            return gda_queen_weights((AbstractGeoDa*)this, order, include_lower_order, precision_threshold);
+        }
+        return gda_rook_weights((AbstractGeoDa*)this, order, include_lower_order, precision_threshold);
     }
-    return w;
+    WeightsCSR csr = PolysToContigCSR(this->main_map, is_queen, precision_threshold, gda_num_threads());
+    return CSRToGeoDaWeight(csr);
 }
 
 std::vector<double> GdaGeojson::GetNumericCol(std::string col_name)
@@ -1,6 +1,7 @@
 #ifndef JSGEODA_GEOJSON
 #define JSGEODA_GEOJSON
 
+#include <functional>
 #include <vector>
 #include <map>
 #include <string>
@@ -9,6 +10,12 @@
 #include "../libgeoda_src/weights/GeodaWeight.h"
 #include "../libgeoda_src/geofeature.h"
 #include "../libgeoda_src/gda_interface.h"
+#include "distance_mst.h"
+#include "knn_weights.h"
+#include "spatial_order.h"
+#include "weights_cache.h"
+#include "weights_components.h"
+#include "weights_csr.h"
 
 class GdaGeojson : public AbstractGeoDa
 {
@@ -41,13 +48,20 @@ public:
     bool IsNumericCol(std::string col_name);
 
     // weights related functions:
+    // if fill_islands_k > 0, the islands are connected to their
+    // fill_islands_k nearest non-island neighbors
     GeoDaWeight* CreateQueenWeights(unsigned int order,
         bool include_lower_order,
- 	    double precision_threshold);
+ 	    double precision_threshold,
+        unsigned int fill_islands_k = 0);
 
     GeoDaWeight* CreateRookWeights(unsigned int order,
         bool include_lower_order,
- 	    double precision_threshold);
+ 	    double precision_threshold,
+        unsigned int fill_islands_k = 0);
+
+    // rook weights of polygons, weighted by the length of the shared border
+    GeoDaWeight* CreateBoundaryLengthWeights(double precision_threshold);
 
     GeoDaWeight* CreateKnnWeights(unsigned int k,
         double power,
@@ -55,6 +69,18 @@ public:
         bool is_arc,
         bool is_mile);
 
+    // knn weights for every k in [k_min, k_max], from one search with k_max.
+    // Returns the uids: the weights of small k can be evicted from the cache
+    // by the ones created after them, so on_created is called with each
+    // weights right after it is created
+    std::vector<std::string> CreateKnnWeightsSweep(unsigned int k_min,
+        unsigned int k_max,
+        double power,
+        bool is_inverse,
+        bool is_arc,
+        bool is_mile,
+        const std::function<void(GeoDaWeight*)>& on_created = nullptr);
+
     GeoDaWeight* CreateDistanceWeights(double dist_thres,
         double power,
         bool is_inverse,
@@ -77,11 +103,58 @@ public:
         bool is_mile);
 
     GeoDaWeight* GetWeights(const std::string& w_uid) {
-        return weights_dict[w_uid];
+        return weights_cache.Get(w_uid);
     }
 
+    // the weights prepared for spatial lags (cached with the weights), in the
+    // spatial order and layout of the map
+    LagWeights* GetLagWeights(const std::string& w_uid);
+
+    // run the spatial lag and LISA loops in the Hilbert order of the centroids
+    // instead of the file order. The results are always in file order
+    void SetSpatialOrder(bool use_hilbert_order);
+
+    bool IsSpatialOrder() const { return use_spatial_order; }
+
+    // connected components and islands of the weights (cached with the weights)
+    const WeightsComponents* GetWeightsComponents(const std::string& w_uid) {
+        return weights_cache.GetComponents(w_uid);
+    }
+
+    // the Hilbert order of the centroids if enabled, otherwise empty
+    const SpatialOrder& GetSpatialOrder();
+
+    // keep the weights of the spatial lag and LISA loops with 32-bit (or
+    // varint) ids and float weights
+    void SetCompactWeights(bool compact) { use_compact_weights = compact; }
+
+    bool IsCompactWeights() const { return use_compact_weights; }
+
+    // evaluate kernel weights on the fly in the spatial lag and LISA loops,
+    // keeping only their neighbor ids and bandwidths
+    void SetImplicitKernelWeights(bool implicit) { use_implicit_kernels = implicit; }
+
+    bool IsImplicitKernelWeights() const { return use_implicit_kernels; }
+
+    // free the weights and forget w_uid
+    bool FreeWeights(const std::string& w_uid);
+
+    // estimated memory of the weights in bytes, 0 if not in memory
+    size_t GetWeightsSize(const std::string& w_uid);
+
+    // minimum spanning tree of the centroids, built once per (is_arc, is_mile)
+    const DistanceMST& GetDistanceMST(bool is_arc, bool is_mile);
+
+    // smallest threshold that gives every observation at least one neighbor
     double GetMinDistanceThreshold(bool is_arc, bool is_mile);
 
+    // smallest threshold that connects all observations
+    double GetConnectivityThreshold(bool is_arc, bool is_mile);
+
+    // number of neighbor pairs (in both directions) of the distance band
+    // weights with dist_thres, without creating the weights
+    size_t CountDistanceNeighbors(double dist_thres, bool is_arc, bool is_mile);
+
     std::string GetFilePath() const { return file_path; }
 
     std::vector<double> GetBounds();
@@ -99,7 +172,26 @@ protected:
 
     std::map<std::string, std::vector<std::string> > data_string;
 
-    std::map<std::string, GeoDaWeight*> weights_dict;
+    WeightsCache weights_cache;
+
+    bool use_spatial_order;
+
+    SpatialOrder spatial_order;
+
+    bool use_compact_weights;
+
+    bool use_implicit_kernels;
+
+    // the side data of weights_cache (see WeightsCache::SetSideData), freed
+    // under budget pressure and built again on next use
+    std::map<std::string, DistanceMST> mst_dict;
+
+    // sorted nearest neighbor lists with the largest k searched so far, shared
+    // by all knn and kernel knn weights
+    std::map<std::string, KnnNeighbors> knn_dict;
+
+    // during a knn sweep, the k of the search of the nearest neighbor lists
+    unsigned int knn_search_k;
 
     std::vector<gda::PointContents*> centroids;
 
@@ -119,6 +211,21 @@ protected:
     void addPolygon(const rapidjson::Value &coords);
 
     void addMultiPolygons(const rapidjson::Value &coords);
+
+    // weights related functions:
+    void getCentroidXY(std::vector<double>& x, std::vector<double>& y);
+
+    WeightsCSR createDistanceBand(double dist_thres, bool is_arc, bool is_mile);
+
+    const KnnNeighbors& getKnnNeighbors(unsigned int k, bool is_arc, bool is_mile);
+
+    void setKernelSpec(const std::string& w_uid, KernelType kernel_type, const std::vector<double>& bandwidths,
+        bool use_kernel_diagonals, bool is_arc, bool is_mile);
+
+    GeoDaWeight* createContiguityWeights(bool is_queen, unsigned int order,
+        bool include_lower_order,
+        double precision_threshold,
+        unsigned int fill_islands_k);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "hilbert.h"
+
+uint32_t HilbertIndex(uint32_t x, uint32_t y)
+{
+    // rotate/flip quadrants from the top level down (xy2d on a 2^16 grid)
+    const uint32_t n = 1u << 16;
+    uint32_t d = 0;
+    for (uint32_t s = n >> 1; s > 0; s >>= 1) {
+        uint32_t rx = (x & s) > 0 ? 1 : 0;
+        uint32_t ry = (y & s) > 0 ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+std::vector<int> HilbertOrder(const std::vector<double>& x, const std::vector<double>& y)
+{
+    size_t n = x.size();
+    std::vector<int> order(n);
+    if (n == 0) return order;
+
+    double min_x = HUGE_VAL, max_x = -HUGE_VAL, min_y = HUGE_VAL, max_y = -HUGE_VAL;
+    for (size_t i = 0; i < n; ++i) {
+        if (!std::isfinite(x[i]) || !std::isfinite(y[i])) continue;
+        min_x = std::min(min_x, x[i]);
+        max_x = std::max(max_x, x[i]);
+        min_y = std::min(min_y, y[i]);
+        max_y = std::max(max_y, y[i]);
+    }
+    double scale_x = max_x > min_x ? 65535.0 / (max_x - min_x) : 0;
+    double scale_y = max_y > min_y ? 65535.0 / (max_y - min_y) : 0;
+
+    std::vector<std::pair<uint32_t, int> > keys(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t hx = 0, hy = 0;
+        if (std::isfinite(x[i]) && std::isfinite(y[i])) {
+            hx = (uint32_t)std::min(65535.0, std::max(0.0, (x[i] - min_x) * scale_x));
+            hy = (uint32_t)std::min(65535.0, std::max(0.0, (y[i] - min_y) * scale_y));
+        }
+        keys[i] = std::make_pair(HilbertIndex(hx, hy), (int)i);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = keys[i].second;
+    }
+    return order;
+}
@@ -0,0 +1,19 @@
+#ifndef JSGEODA_HILBERT_H
+#define JSGEODA_HILBERT_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Index of cell (x, y) along a Hilbert curve filling a 2^16 x 2^16 grid
+ */
+uint32_t HilbertIndex(uint32_t x, uint32_t y);
+
+/**
+ * Order of the points (x, y) along a Hilbert curve over their bounding box:
+ * the returned vector lists the point indices sorted by Hilbert index, so
+ * points that are close in space are also close in the order.
+ */
+std::vector<int> HilbertOrder(const std::vector<double>& x, const std::vector<double>& y);
+
+#endif //JSGEODA_HILBERT_H
@@ -177,6 +177,32 @@ bool is_numeric_col(std::string map_uid, std::string col_name) {
     return false;
 }
 
+void set_spatial_order(std::string map_uid, bool use_hilbert_order) {
+    // the results keep the ids of the file, only the internal loops change order
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        json_map->SetSpatialOrder(use_hilbert_order);
+    }
+}
+
+void set_compact_weights(std::string map_uid, bool compact) {
+    // 32-bit/varint neighbor ids and float weights: the results can differ
+    // from the double weights by float rounding
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        json_map->SetCompactWeights(compact);
+    }
+}
+
+void set_implicit_kernel_weights(std::string map_uid, bool implicit) {
+    // kernel weights keep only their neighbor ids and bandwidths in the
+    // spatial lag loops, and evaluate the kernel on the fly
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        json_map->SetImplicitKernelWeights(implicit);
+    }
+}
+
 std::vector<int> spatial_count(const std::string map_uid, const std::string aggregate_map_uid)
 {
     std::vector<int> counts;
@@ -294,6 +320,8 @@ EMSCRIPTEN_BINDINGS(wasmgeoda) {
     emscripten::register_vector<std::vector<int>>("VecVecInt");
     emscripten::register_vector<double>("VectorDouble");
     emscripten::register_vector<std::vector<double>>("VecVecDouble");
+    emscripten::register_vector<WeightsResult>("VectorWeightsResult");
+    emscripten::register_vector<LisaResult>("VectorLisaResult");
 
     //emscripten::register_map<std::string, std::vector<float> >("map<string, vector<float>>");
 
@@ -316,6 +344,8 @@ EMSCRIPTEN_BINDINGS(wasmgeoda) {
         .function("spatial_lags", &LisaResult::get_lag)
         .function("lisa_values", &LisaResult::get_lisa)
         .function("nn", &LisaResult::get_nn)
+        .function("permutation_counts", &LisaResult::get_perm_counts)
+        .function("permutations_used", &LisaResult::get_perms_used)
         .function("labels", &LisaResult::get_labels)
         .function("colors", &LisaResult::get_colors)
         ;
@@ -335,6 +365,14 @@ EMSCRIPTEN_BINDINGS(wasmgeoda) {
         .function("get_map_uid", &WeightsResult::get_map_uid)
         ;
 
+    emscripten::class_<ComponentsResult>("ComponentsResult")
+        .function("is_valid", &ComponentsResult::get_is_valid)
+        .function("num_components", &ComponentsResult::get_num_components)
+        .function("labels", &ComponentsResult::get_labels)
+        .function("sizes", &ComponentsResult::get_sizes)
+        .function("islands", &ComponentsResult::get_islands)
+        ;
+
     emscripten::class_<ClusteringResult>("ClusteringResult")
         .function("is_valid", &ClusteringResult::get_is_valid)
         .function("clusters", &ClusteringResult::get_clusters)
@@ -354,25 +392,49 @@ EMSCRIPTEN_BINDINGS(wasmgeoda) {
     emscripten::function("get_numeric_col", &get_numeric_col);
     emscripten::function("get_string_col", &get_string_col);
     emscripten::function("get_col_names", &get_col_names);
+    emscripten::function("set_spatial_order", &set_spatial_order);
+    emscripten::function("set_compact_weights", &set_compact_weights);
+    emscripten::function("set_implicit_kernel_weights", &set_implicit_kernel_weights);
 
     emscripten::function("min_distance_threshold", &get_min_dist_threshold);
+    emscripten::function("connectivity_threshold", &get_connectivity_threshold);
+    emscripten::function("dist_weights_nnz", &get_dist_weights_nnz);
     emscripten::function("queen_weights", &queen_weights);
     emscripten::function("rook_weights", &rook_weights);
+    emscripten::function("queen_weights_fill_islands", &queen_weights_fill_islands);
+    emscripten::function("rook_weights_fill_islands", &rook_weights_fill_islands);
+    emscripten::function("rook_length_weights", &rook_length_weights);
     emscripten::function("knn_weights", &knn_weights);
+    emscripten::function("knn_weights_sweep", &knn_weights_sweep);
     emscripten::function("dist_weights", &dist_weights);
     emscripten::function("kernel_weights", &kernel_weights);
     emscripten::function("kernel_bandwidth_weights", &kernel_bandwidth_weights);
-
+    emscripten::function("free_weights", &free_weights);
+    emscripten::function("get_weights_size", &get_weights_size);
+    emscripten::function("set_weights_cache_budget", &set_weights_cache_budget);
+    emscripten::function("weights_components", &weights_components);
+
+    emscripten::function("set_num_cpus", &set_num_cpus);
+    emscripten::function("get_num_cpus", &get_num_cpus);
+    emscripten::function("set_lisa_early_stopping", &set_lisa_early_stopping);
+    emscripten::function("lisa_recategorize", &lisa_recategorize);
     emscripten::function("local_moran", &local_moran);
+    emscripten::function("lisa_session_create", &lisa_session_create);
+    emscripten::function("lisa_session_update", &lisa_session_update);
+    emscripten::function("lisa_session_result", &lisa_session_result);
+    emscripten::function("lisa_session_free", &lisa_session_free);
     emscripten::function("local_moran_eb", &local_moran_eb);
+    emscripten::function("local_moran_batch", &local_moran_batch);
     emscripten::function("local_g", &local_g);
     emscripten::function("local_gstar", &local_gstar);
     emscripten::function("local_geary", &local_geary);
     emscripten::function("local_joincount", &local_joincount);
+    emscripten::function("local_joincount_mask", &local_joincount_mask);
     emscripten::function("quantile_lisa", &quantile_lisa);
     emscripten::function("neighbor_match_test", &neighbor_match_test);
     emscripten::function("multi_quantile_lisa", &multi_quantile_lisa);
     emscripten::function("local_multijoincount", &local_multijoincount);
+    emscripten::function("local_multijoincount_mask", &local_multijoincount_mask);
     emscripten::function("local_multigeary", &local_multigeary);
 
     emscripten::function("redcap", &redcap);
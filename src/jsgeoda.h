@@ -54,6 +54,25 @@ struct WeightsResult {
     std::string get_map_uid() { return map_uid;}
 };
 
+/**
+ * ComponentsResult
+ *
+ * It is used to return the connected components and islands of weights to js
+ */
+struct ComponentsResult {
+    bool is_valid;
+    int num_components;
+    std::vector<int> labels;
+    std::vector<int> sizes;
+    std::vector<int> islands;
+
+    bool get_is_valid() { return is_valid;}
+    int get_num_components() { return num_components;}
+    std::vector<int> get_labels() { return labels;}
+    std::vector<int> get_sizes() { return sizes;}
+    std::vector<int> get_islands() { return islands;}
+};
+
 std::vector<int> spatial_count(const std::string map_uid, const std::string aggregate_map_uid);
 
 /**
@@ -66,8 +85,19 @@ WeightsResult queen_weights(std::string map_uid, int order, int include_lower_or
 
 WeightsResult rook_weights(std::string map_uid, int order, int include_lower_order, double precision_threshold);
 
+WeightsResult queen_weights_fill_islands(std::string map_uid, int order, int include_lower_order,
+                                        double precision_threshold, int k);
+
+WeightsResult rook_weights_fill_islands(std::string map_uid, int order, int include_lower_order,
+                                       double precision_threshold, int k);
+
+WeightsResult rook_length_weights(std::string map_uid, double precision_threshold);
+
 WeightsResult knn_weights(std::string map_uid, int k, double power, bool is_inverse, bool is_arc, bool is_mile);
 
+std::vector<WeightsResult> knn_weights_sweep(std::string map_uid, int k_min, int k_max, double power, bool is_inverse,
+                                             bool is_arc, bool is_mile);
+
 WeightsResult dist_weights(std::string map_uid, double dist_thres, double power, bool is_inverse, bool is_arc,
         bool is_mile);
 
@@ -80,6 +110,18 @@ WeightsResult kernel_bandwidth_weights(std::string map_uid, double dist_thres, s
 
 double get_min_dist_threshold(std::string map_uid, bool is_arc, bool is_mile);
 
+double get_connectivity_threshold(std::string map_uid, bool is_arc, bool is_mile);
+
+bool free_weights(std::string map_uid, std::string weight_uid);
+
+double get_weights_size(std::string map_uid, std::string weight_uid);
+
+void set_weights_cache_budget(double bytes);
+
+ComponentsResult weights_components(std::string map_uid, std::string weight_uid);
+
+double get_dist_weights_nnz(std::string map_uid, double dist_thres, bool is_arc, bool is_mile);
+
 /**
  *  Functions of mapping
  */
@@ -135,6 +177,9 @@ struct LisaResult {
     std::vector<double> lag_vec;
     std::vector<double> lisa_vec;
     std::vector<int> nn_vec;
+    std::vector<int> sig_cluster_vec;
+    std::vector<int> perm_counts_vec;
+    std::vector<int> perms_used_vec;
     std::vector<std::string> labels;
     std::vector<std::string> colors;
 
@@ -145,18 +190,50 @@ struct LisaResult {
     std::vector<double>  get_lag() { return lag_vec;}
     std::vector<double>  get_lisa() { return lisa_vec;}
     std::vector<int>  get_nn() { return nn_vec;}
+    std::vector<int>  get_perm_counts() { return perm_counts_vec;}
+    std::vector<int>  get_perms_used() { return perms_used_vec;}
     std::vector<std::string>  get_labels() { return labels;}
     std::vector<std::string>  get_colors() { return colors;}
 };
 
-class LISA;
+struct LisaOutput;
+
+void set_lisa_content(const LisaOutput& lisa, LisaResult& rst);
+
+// number of threads of the LISA permutations (and the weights routines)
+void set_num_cpus(int nCPUs);
+
+int get_num_cpus();
 
-void set_lisa_content(LISA* lisa, LisaResult& rst);
+// stop the permutations of an observation once it cannot be significant
+void set_lisa_early_stopping(bool early_stopping);
+
+// the lisa result with the clusters of another significance cutoff, and
+// correction "bonferroni", "fdr" or "none"; no permutations run
+LisaResult lisa_recategorize(const LisaResult& lisa, double significance_cutoff, const std::string& correction);
 
 LisaResult local_moran(const std::string map_uid, const std::string weight_uid, const std::vector<double>& vals,
                        const std::vector<int>& undefs, double significance_cutoff, int permutations,
                        const std::string& permutation_method, int last_seed_used);
 
+// a local Moran session for what-if edits of the data: returns its uid, ""
+// if the map or the weights are not found
+std::string lisa_session_create(const std::string map_uid, const std::string weight_uid,
+                                const std::vector<double>& vals, const std::vector<int>& undefs,
+                                double significance_cutoff, int permutations, const std::string& permutation_method,
+                                int last_seed_used);
+
+// set vals[indices[k]] = values[k]: only the observations affected by the
+// edits run the permutations again (see LocalMoranSession). On maps of 1000
+// observations or more, the p-values and clusters of the others can then
+// differ from those of local_moran on the edited values
+LisaResult lisa_session_update(const std::string session_uid, const std::vector<int>& indices,
+                               const std::vector<double>& values);
+
+LisaResult lisa_session_result(const std::string session_uid);
+
+void lisa_session_free(const std::string session_uid);
+
 LisaResult local_g(const std::string map_uid, const std::string weight_uid, const std::vector<double>& vals,
                    const std::vector<int>& undefs, double significance_cutoff, int permutations,
                    const std::string& permutation_method, int last_seed_used);
@@ -173,6 +250,21 @@ LisaResult local_joincount(const std::string map_uid, const std::string weight_u
                        const std::vector<int>& undefs, double significance_cutoff, int permutations,
                        const std::string& permutation_method, int last_seed_used);
 
+// local join count of a packed 0/1 mask: x_i is bit i % 32 of mask[i / 32]
+// (the words of a JS Int32Array), undefined where undef_mask is 1 (may be
+// empty)
+LisaResult local_joincount_mask(const std::string map_uid, const std::string weight_uid, const std::vector<int>& mask,
+                                const std::vector<int>& undef_mask, double significance_cutoff, int permutations,
+                                const std::string& permutation_method, int last_seed_used);
+
+// co-location join count of packed masks: 1 where all the masks are 1. Two
+// masks that are never both 1 get the bivariate join count of the first with
+// the second
+LisaResult local_multijoincount_mask(const std::string map_uid, const std::string weight_uid,
+                                     const std::vector<std::vector<int> >& masks,
+                                     const std::vector<std::vector<int> >& undef_masks, double significance_cutoff,
+                                     int permutations, const std::string& permutation_method, int last_seed_used);
+
 LisaResult quantile_lisa(const std::string map_uid, const std::string weight_uid, int k, int quantile,
                          const std::vector<double>& vals, const std::vector<int>& undefs, double significance_cutoff,
                          int permutations, const std::string& permutation_method, int last_seed_used);
@@ -193,6 +285,14 @@ LisaResult multi_quantile_lisa(const std::string map_uid, const std::string weig
                                double significance_cutoff, int permutations,
                                const std::string& permutation_method, int last_seed_used);
 
+// local Moran of every column of data, drawing the random neighbors once for
+// all the columns
+std::vector<LisaResult> local_moran_batch(const std::string map_uid, const std::string weight_uid,
+                                          const std::vector<std::vector<double> > &data,
+                                          const std::vector<std::vector<int> > &undefs, double significance_cutoff,
+                                          int permutations, const std::string& permutation_method,
+                                          int last_seed_used);
+
 LisaResult local_multijoincount(const std::string map_uid, const std::string weight_uid,
                            const std::vector<std::vector<double> > &data,
                            const std::vector<std::vector<int> > &undefs, double significance_cutoff,
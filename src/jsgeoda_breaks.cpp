@@ -11,6 +11,7 @@
 #include "../libgeoda_src/weights/GalWeight.h"
 #include "../libgeoda_src/GenUtils.h"
 #include "geojson.h"
+#include "spatial_lag.h"
 #include "jsgeoda.h"
 
 extern std::map<std::string, GdaGeojson*> geojson_maps;
@@ -134,45 +135,9 @@ std::vector<double> spatial_lag(const std::string map_uid,
 {
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int obs = (int)data.size();
-            std::vector<double> result(obs);
-            std::vector<bool> undefs(obs, false);
-
-            for (int i=0; i<obs; ++i) {
-                std::vector<long> nbrs = w->GetNeighbors(i);
-                std::vector<double> wvals = w->GetNeighborWeights(i);
-                double lag = 0;
-                if (is_binary || wvals.empty()) {
-                    for (int j=0; j < nbrs.size(); ++j) {
-                        if (nbrs[j] != i || inc_diag) {
-                            lag += data[nbrs[j]];
-                        }
-                    }
-                    if (nbrs.empty() == false && row_stand) {
-                        lag = lag / nbrs.size();
-                    }
-                } else {
-                    double sumW = 0;
-                    for (int j=0; j < nbrs.size(); ++j) {
-                        if (nbrs[j] != i || inc_diag) {
-                            sumW += wvals[j];
-                        }
-                    }
-                    if (sumW ==0) {
-                        lag = 0;
-                    } else {
-                        for (int j = 0; j < nbrs.size(); ++j) {
-                            if (nbrs[j] != i || inc_diag) {
-                                lag += data[nbrs[j]] * wvals[j] / sumW;
-                            }
-                        }
-                    }
-                }
-                result[i] = lag;
-            }
-            return result;
+            return SpatialLag(*w, data, is_binary, row_stand, inc_diag);
         }
     }
     return std::vector<double>();
@@ -9,6 +9,20 @@
 
 extern std::map<std::string, GdaGeojson*> geojson_maps;
 
+namespace {
+    // the regions of redcap, azp and maxp are connected in the weights graph:
+    // an island can never join a region, and k regions cannot cover more
+    // than k components. Check before running instead of returning garbage
+    bool is_valid_contiguity(GdaGeojson *json_map, const std::string& weight_uid, int k)
+    {
+        const WeightsComponents* comp = json_map->GetWeightsComponents(weight_uid);
+        if (comp == 0 || comp->HasIslands()) {
+            return false;
+        }
+        return k <= 0 || comp->num_components <= k;
+    }
+}
+
 ClusteringResult redcap(const std::string map_uid, const std::string weight_uid, int k, const std::string &method,
                         const std::vector<std::vector<double> > &data,
                         const std::vector<double>& bound_vals, double min_bound,
@@ -19,8 +33,9 @@ ClusteringResult redcap(const std::string map_uid, const std::string weight_uid,
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
+        bool is_valid_w = is_valid_contiguity(json_map, weight_uid, k);
         GeoDaWeight *w = json_map->GetWeights(weight_uid);
-        if (w) {
+        if (w && is_valid_w) {
             int nCPUs = 1;
             int seed = 123456789;// not used
             std::vector<std::vector<int> > cluster_ids = gda_redcap(k, w, data, scale_method, method, distance_method,
@@ -75,8 +90,9 @@ ClusteringResult azp_greedy(const std::string map_uid, const std::string weight_
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
+        bool is_valid_w = is_valid_contiguity(json_map, weight_uid, k);
         GeoDaWeight *w = json_map->GetWeights(weight_uid);
-        if (w) {
+        if (w && is_valid_w) {
             int seed = 123456789;// not used
 
             std::vector<std::pair<double, std::vector<double> > > in_min_bounds, in_max_bounds;
@@ -115,8 +131,9 @@ ClusteringResult azp_sa(const std::string map_uid, const std::string weight_uid,
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
+        bool is_valid_w = is_valid_contiguity(json_map, weight_uid, k);
         GeoDaWeight *w = json_map->GetWeights(weight_uid);
-        if (w) {
+        if (w && is_valid_w) {
             int seed = 123456789;// not used
 
             std::vector<std::pair<double, std::vector<double> > > in_min_bounds, in_max_bounds;
@@ -155,8 +172,9 @@ ClusteringResult azp_tabu(const std::string map_uid, const std::string weight_ui
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
+        bool is_valid_w = is_valid_contiguity(json_map, weight_uid, k);
         GeoDaWeight *w = json_map->GetWeights(weight_uid);
-        if (w) {
+        if (w && is_valid_w) {
             int seed = 123456789;// not used
 
             std::vector<std::pair<double, std::vector<double> > > in_min_bounds, in_max_bounds;
@@ -195,8 +213,9 @@ ClusteringResult maxp_greedy(const std::string map_uid, const std::string weight
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
+        bool is_valid_w = is_valid_contiguity(json_map, weight_uid, 0);
         GeoDaWeight *w = json_map->GetWeights(weight_uid);
-        if (w) {
+        if (w && is_valid_w) {
             int seed = 123456789;// not used
 
             std::vector<std::pair<double, std::vector<double> > > in_min_bounds, in_max_bounds;
@@ -235,8 +254,9 @@ ClusteringResult maxp_sa(const std::string map_uid, const std::string weight_uid
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
+        bool is_valid_w = is_valid_contiguity(json_map, weight_uid, 0);
         GeoDaWeight *w = json_map->GetWeights(weight_uid);
-        if (w) {
+        if (w && is_valid_w) {
             int seed = 123456789;// not used
 
             std::vector<std::pair<double, std::vector<double> > > in_min_bounds, in_max_bounds;
@@ -275,8 +295,9 @@ ClusteringResult maxp_tabu(const std::string map_uid, const std::string weight_u
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
+        bool is_valid_w = is_valid_contiguity(json_map, weight_uid, 0);
         GeoDaWeight *w = json_map->GetWeights(weight_uid);
-        if (w) {
+        if (w && is_valid_w) {
             int seed = 123456789;// not used
 
             std::vector<std::pair<double, std::vector<double> > > in_min_bounds, in_max_bounds;
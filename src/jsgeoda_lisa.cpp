@@ -2,28 +2,130 @@
 // Created by Xun Li on 2/1/21. <lixun910@gmail.com>
 //
 
-#include "../libgeoda_src/sa/UniLocalMoran.h"
-#include "../libgeoda_src/sa/UniG.h"
+#include <cfloat>
+#include <map>
+#include <memory>
+
 #include "../libgeoda_src/gda_sa.h"
-#include "../libgeoda_src/weights/GalWeight.h"
 #include "../libgeoda_src/GenUtils.h"
 #include "geojson.h"
+#include "lisa_engine.h"
+#include "parallel.h"
+#include "spatial_lag.h"
 #include "jsgeoda.h"
 
 extern std::map<std::string, GdaGeojson*> geojson_maps;
 
+namespace {
+    bool lisa_early_stopping = false;
+
+    // a local Moran session and its map and weights
+    struct LisaSessionEntry {
+        std::string map_uid;
+        std::string weight_uid;
+        std::unique_ptr<LocalMoranSession> session;
+    };
+    std::map<std::string, LisaSessionEntry> lisa_sessions;
+    int lisa_session_count = 0;
+
+    LisaParams make_lisa_params(double significance_cutoff, int nCPUs, int permutations,
+                                const std::string& permutation_method, int last_seed_used)
+    {
+        LisaParams params;
+        params.significance_cutoff = significance_cutoff;
+        params.permutations = permutations;
+        params.permutation_method = permutation_method;
+        params.last_seed_used = (uint64_t)last_seed_used;
+        params.n_threads = nCPUs;
+        params.early_stopping = lisa_early_stopping;
+        return params;
+    }
+
+    std::vector<bool> to_undefs(const std::vector<int>& undefs, size_t num_obs)
+    {
+        std::vector<bool> undefs_b(num_obs, false);
+        for (size_t i=0; i<undefs.size() && i<num_obs; ++i) {
+            undefs_b[i] = undefs[i] == 0 ? false : true;
+        }
+        return undefs_b;
+    }
+
+    // the 32-bit words of a JS Int32Array / Uint32Array
+    BitMask to_mask(const std::vector<int>& words)
+    {
+        BitMask mask(words.size());
+        for (size_t k=0; k<words.size(); ++k) mask[k] = (uint32_t)words[k];
+        return mask;
+    }
 
-void set_lisa_content(LISA* lisa, LisaResult& rst)
+    // 1 for the values in the quantile-th (1..k) quantile of the data, else 0
+    std::vector<double> quantile_indicator(int k, int quantile, const std::vector<double>& data,
+                                           std::vector<bool>& undefs)
+    {
+        std::vector<double> breaks = GenUtils::QuantileBreaks(k, data, undefs);
+        breaks.insert(breaks.begin(), -DBL_MAX);
+        breaks.push_back(DBL_MAX);
+        std::vector<double> bin_data(data.size(), 0);
+        if (quantile < 1 || quantile >= (int)breaks.size()) {
+            return bin_data;
+        }
+        for (size_t i=0; i<data.size(); ++i) {
+            if (data[i] >= breaks[quantile-1] && data[i] < breaks[quantile]) {
+                bin_data[i] = 1;
+            }
+        }
+        return bin_data;
+    }
+}
+
+void set_lisa_content(const LisaOutput& lisa, LisaResult& rst)
 {
     rst.is_valid = true;
-    rst.sig_local_vec = lisa->GetLocalSignificanceValues();
-    rst.sig_cat_vec = lisa->GetSigCatIndicators();
-    rst.cluster_vec = lisa->GetClusterIndicators();
-    rst.lag_vec = lisa->GetSpatialLagValues();
-    rst.lisa_vec = lisa->GetLISAValues();
-    rst.nn_vec = lisa->GetNumNeighbors();
-    rst.labels = lisa->GetLabels();
-    rst.colors = lisa->GetColors();
+    rst.sig_local_vec = lisa.sig_local;
+    rst.sig_cat_vec = lisa.sig_cats;
+    rst.cluster_vec = lisa.clusters;
+    rst.lag_vec = lisa.lags;
+    rst.lisa_vec = lisa.lisa_vals;
+    rst.nn_vec = lisa.nn;
+    rst.sig_cluster_vec = lisa.sig_clusters;
+    rst.perm_counts_vec = lisa.perm_counts;
+    rst.perms_used_vec = lisa.perms_used;
+    rst.labels = lisa.labels;
+    rst.colors = lisa.colors;
+}
+
+void set_num_cpus(int nCPUs)
+{
+    // the results do not depend on the number of threads; a single-thread
+    // build always uses 1
+    gda_set_num_threads(nCPUs);
+}
+
+int get_num_cpus()
+{
+    return gda_num_threads();
+}
+
+void set_lisa_early_stopping(bool early_stopping)
+{
+    lisa_early_stopping = early_stopping;
+}
+
+LisaResult lisa_recategorize(const LisaResult& lisa, double significance_cutoff, const std::string& correction)
+{
+    LisaResult rst = lisa;
+    if (!lisa.is_valid) return rst;
+
+    LisaOutput out;
+    out.sig_local = lisa.sig_local_vec;
+    out.sig_cats = lisa.sig_cat_vec;
+    out.clusters = lisa.cluster_vec;
+    out.sig_clusters = lisa.sig_cluster_vec;
+    out.labels = lisa.labels;
+    Recategorize(out, significance_cutoff, correction);
+    rst.sig_cat_vec = out.sig_cats;
+    rst.cluster_vec = out.clusters;
+    return rst;
 }
 
 LisaResult local_moran(const std::string map_uid, const std::string weight_uid, const std::vector<double>& vals,
@@ -35,22 +137,73 @@ LisaResult local_moran(const std::string map_uid, const std::string weight_uid,
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            std::vector<bool> undefs_b(vals.size(), false);
-            for (size_t i=0; i<undefs.size(); ++i) {
-                undefs_b[i] = undefs[i] == 0 ? false : true;
-            }
-            LISA* lisa = gda_localmoran(w, vals, undefs_b, significance_cutoff, nCPUs, permutations,
-                                        permutation_method, last_seed_used);
+            int nCPUs = gda_num_threads();
+            std::vector<bool> undefs_b = to_undefs(undefs, vals.size());
+            LisaOutput lisa = LocalMoran(*w, vals, undefs_b, make_lisa_params(significance_cutoff, nCPUs,
+                                         permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
 }
 
+std::string lisa_session_create(const std::string map_uid, const std::string weight_uid,
+                                const std::vector<double>& vals, const std::vector<int>& undefs,
+                                double significance_cutoff, int permutations, const std::string& permutation_method,
+                                int last_seed_used)
+{
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map == 0) return "";
+    LagWeights *w = json_map->GetLagWeights(weight_uid);
+    if (w == 0) return "";
+
+    int nCPUs = gda_num_threads();
+    std::vector<bool> undefs_b = to_undefs(undefs, vals.size());
+    std::string uid = "lisa_session_" + std::to_string(++lisa_session_count);
+    LisaSessionEntry& entry = lisa_sessions[uid];
+    entry.map_uid = map_uid;
+    entry.weight_uid = weight_uid;
+    entry.session.reset(new LocalMoranSession(*w, vals, undefs_b, make_lisa_params(significance_cutoff, nCPUs,
+                                              permutations, permutation_method, last_seed_used)));
+    return uid;
+}
+
+LisaResult lisa_session_update(const std::string session_uid, const std::vector<int>& indices,
+                               const std::vector<double>& values)
+{
+    LisaResult rst;
+    rst.is_valid = false;
+
+    std::map<std::string, LisaSessionEntry>::iterator it = lisa_sessions.find(session_uid);
+    if (it != lisa_sessions.end()) {
+        GdaGeojson *json_map = geojson_maps[it->second.map_uid];
+        LagWeights *w = json_map ? json_map->GetLagWeights(it->second.weight_uid) : 0;
+        if (w) {
+            set_lisa_content(it->second.session->Update(*w, indices, values), rst);
+        }
+    }
+    return rst;
+}
+
+LisaResult lisa_session_result(const std::string session_uid)
+{
+    LisaResult rst;
+    rst.is_valid = false;
+
+    std::map<std::string, LisaSessionEntry>::iterator it = lisa_sessions.find(session_uid);
+    if (it != lisa_sessions.end()) {
+        set_lisa_content(it->second.session->GetOutput(), rst);
+    }
+    return rst;
+}
+
+void lisa_session_free(const std::string session_uid)
+{
+    lisa_sessions.erase(session_uid);
+}
+
 LisaResult local_g(const std::string map_uid, const std::string weight_uid, const std::vector<double>& vals,
                    const std::vector<int>& undefs, double significance_cutoff, int permutations,
                    const std::string& permutation_method, int last_seed_used)
@@ -60,17 +213,13 @@ LisaResult local_g(const std::string map_uid, const std::string weight_uid, cons
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            std::vector<bool> undefs_b(undefs.size());
-            for (size_t i=0; i<undefs.size(); ++i) {
-                undefs_b[i] = undefs[i] == 0 ? false : true;
-            }
-            LISA* lisa = gda_localg(w, vals, undefs_b, significance_cutoff, nCPUs, permutations,
-                                    permutation_method, last_seed_used);
+            int nCPUs = gda_num_threads();
+            std::vector<bool> undefs_b = to_undefs(undefs, vals.size());
+            LisaOutput lisa = LocalG(*w, vals, undefs_b, false, make_lisa_params(significance_cutoff, nCPUs,
+                                     permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
@@ -85,17 +234,13 @@ LisaResult local_gstar(const std::string map_uid, const std::string weight_uid,
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            std::vector<bool> undefs_b(undefs.size());
-            for (size_t i=0; i<undefs.size(); ++i) {
-                undefs_b[i] = undefs[i] == 0 ? false : true;
-            }
-            LISA* lisa = gda_localgstar(w, vals, undefs_b, significance_cutoff, nCPUs, permutations,
-                                    permutation_method, last_seed_used);
+            int nCPUs = gda_num_threads();
+            std::vector<bool> undefs_b = to_undefs(undefs, vals.size());
+            LisaOutput lisa = LocalG(*w, vals, undefs_b, true, make_lisa_params(significance_cutoff, nCPUs,
+                                     permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
@@ -110,17 +255,13 @@ LisaResult local_geary(const std::string map_uid, const std::string weight_uid,
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            std::vector<bool> undefs_b(undefs.size());
-            for (size_t i=0; i<undefs.size(); ++i) {
-                undefs_b[i] = undefs[i] == 0 ? false : true;
-            }
-            LISA* lisa = gda_localgeary(w, vals, undefs_b, significance_cutoff, nCPUs, permutations,
-                                    permutation_method, last_seed_used);
+            int nCPUs = gda_num_threads();
+            std::vector<bool> undefs_b = to_undefs(undefs, vals.size());
+            LisaOutput lisa = LocalGeary(*w, vals, undefs_b, make_lisa_params(significance_cutoff, nCPUs,
+                                         permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
@@ -135,17 +276,58 @@ LisaResult local_joincount(const std::string map_uid, const std::string weight_u
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            std::vector<bool> undefs_b(undefs.size());
-            for (size_t i=0; i<undefs.size(); ++i) {
-                undefs_b[i] = undefs[i] == 0 ? false : true;
-            }
-            LISA* lisa = gda_localjoincount(w, vals, undefs_b, significance_cutoff, nCPUs, permutations,
-                                            permutation_method, last_seed_used);
+            int nCPUs = gda_num_threads();
+            std::vector<bool> undefs_b = to_undefs(undefs, vals.size());
+            LisaOutput lisa = LocalJoinCount(*w, vals, undefs_b, make_lisa_params(significance_cutoff, nCPUs,
+                                             permutations, permutation_method, last_seed_used));
+            set_lisa_content(lisa, rst);
+        }
+    }
+    return rst;
+}
+
+LisaResult local_joincount_mask(const std::string map_uid, const std::string weight_uid, const std::vector<int>& mask,
+                                const std::vector<int>& undef_mask, double significance_cutoff, int permutations,
+                                const std::string& permutation_method, int last_seed_used)
+{
+    LisaResult rst;
+    rst.is_valid = false;
+
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
+        if (w) {
+            int nCPUs = gda_num_threads();
+            LisaOutput lisa = LocalJoinCount(*w, to_mask(mask), to_mask(undef_mask), make_lisa_params(
+                                             significance_cutoff, nCPUs, permutations, permutation_method,
+                                             last_seed_used));
+            set_lisa_content(lisa, rst);
+        }
+    }
+    return rst;
+}
+
+LisaResult local_multijoincount_mask(const std::string map_uid, const std::string weight_uid,
+                                     const std::vector<std::vector<int> >& masks,
+                                     const std::vector<std::vector<int> >& undef_masks, double significance_cutoff,
+                                     int permutations, const std::string& permutation_method, int last_seed_used)
+{
+    LisaResult rst;
+    rst.is_valid = false;
+
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map && !masks.empty()) {
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
+        if (w) {
+            int nCPUs = gda_num_threads();
+            std::vector<BitMask> masks_u(masks.size()), undef_masks_u(undef_masks.size());
+            for (size_t i=0; i<masks.size(); ++i) masks_u[i] = to_mask(masks[i]);
+            for (size_t i=0; i<undef_masks.size(); ++i) undef_masks_u[i] = to_mask(undef_masks[i]);
+            LisaOutput lisa = LocalMultiJoinCount(*w, masks_u, undef_masks_u, make_lisa_params(significance_cutoff,
+                                                  nCPUs, permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
@@ -160,17 +342,14 @@ LisaResult quantile_lisa(const std::string map_uid, const std::string weight_uid
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            std::vector<bool> undefs_b(undefs.size());
-            for (size_t i=0; i<undefs.size(); ++i) {
-                undefs_b[i] = undefs[i] == 0 ? false : true;
-            }
-            LISA* lisa = gda_quantilelisa(w, k, quantile, vals, undefs_b, significance_cutoff, nCPUs, permutations,
-                                            permutation_method, last_seed_used);
+            int nCPUs = gda_num_threads();
+            std::vector<bool> undefs_b = to_undefs(undefs, vals.size());
+            std::vector<double> bin_data = quantile_indicator(k, quantile, vals, undefs_b);
+            LisaOutput lisa = LocalJoinCount(*w, bin_data, undefs_b, make_lisa_params(significance_cutoff, nCPUs,
+                                             permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
@@ -185,13 +364,14 @@ LisaResult local_moran_eb(const std::string map_uid, const std::string weight_ui
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            LISA* lisa = gda_localmoran_eb(w, vals, base_values, significance_cutoff, nCPUs, permutations,
-                                        permutation_method, last_seed_used);
+            int nCPUs = gda_num_threads();
+            std::vector<bool> undefs_b(vals.size(), false);
+            std::vector<double> eb_rates = RateStandardizeEB(vals, base_values, undefs_b);
+            LisaOutput lisa = LocalMoran(*w, eb_rates, undefs_b, make_lisa_params(significance_cutoff, nCPUs,
+                                         permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
@@ -207,20 +387,44 @@ LisaResult local_multigeary(const std::string map_uid, const std::string weight_
 
     GdaGeojson *json_map = geojson_maps[map_uid];
     if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
+            int nCPUs = gda_num_threads();
             std::vector<std::vector<bool> > undefs_b(data.size());
             for (size_t i=0; i<data.size(); ++i) {
-                undefs_b[i].resize(data[i].size(), false);
-                for (size_t j=0; j < data[i].size(); ++j) {
-                    undefs_b[i][j] = undefs[i][j] == 0 ? false : true;
-                }
+                undefs_b[i] = to_undefs(i < undefs.size() ? undefs[i] : std::vector<int>(), data[i].size());
             }
-            LISA* lisa = gda_localmultigeary(w, data, undefs_b, significance_cutoff, nCPUs, permutations,
-                                        permutation_method, last_seed_used);
+            LisaOutput lisa = LocalMultiGeary(*w, data, undefs_b, make_lisa_params(significance_cutoff, nCPUs,
+                                              permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
+        }
+    }
+    return rst;
+}
+
+std::vector<LisaResult> local_moran_batch(const std::string map_uid, const std::string weight_uid,
+                                          const std::vector<std::vector<double> > &data,
+                                          const std::vector<std::vector<int> > &undefs, double significance_cutoff,
+                                          int permutations, const std::string& permutation_method,
+                                          int last_seed_used)
+{
+    std::vector<LisaResult> rst(data.size());
+    for (size_t i=0; i<rst.size(); ++i) rst[i].is_valid = false;
+
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
+        if (w) {
+            int nCPUs = gda_num_threads();
+            std::vector<std::vector<bool> > undefs_b(data.size());
+            for (size_t i=0; i<data.size(); ++i) {
+                undefs_b[i] = to_undefs(i < undefs.size() ? undefs[i] : std::vector<int>(), data[i].size());
+            }
+            std::vector<LisaOutput> lisa = LocalMoranBatch(*w, data, undefs_b, make_lisa_params(significance_cutoff,
+                                                           nCPUs, permutations, permutation_method, last_seed_used));
+            for (size_t i=0; i<lisa.size(); ++i) {
+                set_lisa_content(lisa[i], rst[i]);
+            }
         }
     }
     return rst;
@@ -235,21 +439,19 @@ LisaResult local_multijoincount(const std::string map_uid, const std::string wei
     rst.is_valid = false;
 
     GdaGeojson *json_map = geojson_maps[map_uid];
-    if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+    if (json_map && !data.empty()) {
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            std::vector<std::vector<bool> > undefs_b(data.size());
+            int nCPUs = gda_num_threads();
+            // co-location: 1 where all the variables are 1
+            std::vector<BitMask> masks(data.size()), undef_masks(data.size());
             for (size_t i=0; i<data.size(); ++i) {
-                undefs_b[i].resize(data[i].size(), false);
-                for (size_t j=0; j < data[i].size(); ++j) {
-                    undefs_b[i][j] = undefs[i][j] == 0 ? false : true;
-                }
+                masks[i] = PackMask(data[i]);
+                if (i < undefs.size()) undef_masks[i] = PackMask(to_undefs(undefs[i], data[i].size()));
             }
-            LISA* lisa = gda_localmultijoincount(w, data, undefs_b, significance_cutoff, nCPUs, permutations,
-                                             permutation_method, last_seed_used);
+            LisaOutput lisa = LocalMultiJoinCount(*w, masks, undef_masks, make_lisa_params(significance_cutoff,
+                                                  nCPUs, permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
@@ -266,21 +468,21 @@ LisaResult multi_quantile_lisa(const std::string map_uid, const std::string weig
     rst.is_valid = false;
 
     GdaGeojson *json_map = geojson_maps[map_uid];
-    if (json_map) {
-        GeoDaWeight *w = json_map->GetWeights(weight_uid);
+    if (json_map && !data.empty() && k_s.size() >= data.size() && quantile_s.size() >= data.size()) {
+        LagWeights *w = json_map->GetLagWeights(weight_uid);
         if (w) {
-            int nCPUs = 1;
-            std::vector<std::vector<bool> > undefs_b(data.size());
+            int nCPUs = gda_num_threads();
+            // co-location of the quantiles of all the variables
+            std::vector<BitMask> masks(data.size()), undef_masks(data.size());
             for (size_t i=0; i<data.size(); ++i) {
-                undefs_b[i].resize(data[i].size(), false);
-                for (size_t j=0; j < data[i].size(); ++j) {
-                    undefs_b[i][j] = undefs[i][j] == 0 ? false : true;
-                }
+                std::vector<bool> var_undefs = to_undefs(i < undefs.size() ? undefs[i] : std::vector<int>(),
+                                                         data[i].size());
+                masks[i] = PackMask(quantile_indicator(k_s[i], quantile_s[i], data[i], var_undefs));
+                undef_masks[i] = PackMask(var_undefs);
             }
-            LISA* lisa = gda_multiquantilelisa(w, k_s, quantile_s, data, undefs_b, significance_cutoff, nCPUs, permutations,
-                                                 permutation_method, last_seed_used);
+            LisaOutput lisa = LocalMultiJoinCount(*w, masks, undef_masks, make_lisa_params(significance_cutoff,
+                                                  nCPUs, permutations, permutation_method, last_seed_used));
             set_lisa_content(lisa, rst);
-            delete lisa;
         }
     }
     return rst;
@@ -55,6 +55,47 @@ WeightsResult rook_weights(std::string map_uid, int order, int include_lower_ord
     return rst;
 }
 
+WeightsResult queen_weights_fill_islands(std::string map_uid, int order, int include_lower_order,
+                                        double precision_threshold, int k)
+{
+    // contiguity weights with every island connected to its k nearest
+    // non-island neighbors, in one build
+    WeightsResult rst;
+    rst.is_valid = false;
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map && k > 0) {
+        GeoDaWeight *w = json_map->CreateQueenWeights(order, include_lower_order, precision_threshold, k);
+        set_weights_content(w, map_uid, rst);
+    }
+    return rst;
+}
+
+WeightsResult rook_weights_fill_islands(std::string map_uid, int order, int include_lower_order,
+                                       double precision_threshold, int k)
+{
+    WeightsResult rst;
+    rst.is_valid = false;
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map && k > 0) {
+        GeoDaWeight *w = json_map->CreateRookWeights(order, include_lower_order, precision_threshold, k);
+        set_weights_content(w, map_uid, rst);
+    }
+    return rst;
+}
+
+WeightsResult rook_length_weights(std::string map_uid, double precision_threshold)
+{
+    // gwt weights: the length of the border shared by two polygons, in map units
+    WeightsResult rst;
+    rst.is_valid = false;
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        GeoDaWeight *w = json_map->CreateBoundaryLengthWeights(precision_threshold);
+        set_weights_content(w, map_uid, rst);
+    }
+    return rst;
+}
+
 WeightsResult knn_weights(std::string map_uid, int k, double power, bool is_inverse, bool is_arc, bool is_mile)
 {
     //std::cout << "knn_weights()" << map_uid << std::endl;
@@ -68,6 +109,25 @@ WeightsResult knn_weights(std::string map_uid, int k, double power, bool is_inve
     return rst;
 }
 
+std::vector<WeightsResult> knn_weights_sweep(std::string map_uid, int k_min, int k_max, double power, bool is_inverse,
+                                             bool is_arc, bool is_mile)
+{
+    std::vector<WeightsResult> rst;
+
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map && k_min > 0 && k_min <= k_max) {
+        // the results are set while each weights is in memory: the first ones
+        // can be evicted by the last ones
+        json_map->CreateKnnWeightsSweep(k_min, k_max, power, is_inverse, is_arc, is_mile, [&](GeoDaWeight* w) {
+            WeightsResult w_rst;
+            w_rst.is_valid = false;
+            set_weights_content(w, map_uid, w_rst);
+            rst.push_back(w_rst);
+        });
+    }
+    return rst;
+}
+
 WeightsResult dist_weights(std::string map_uid, double dist_thres, double power, bool is_inverse, bool is_arc, bool is_mile)
 {
     //std::cout << "distance_weights()" << map_uid << std::endl;
@@ -121,3 +181,68 @@ double get_min_dist_threshold(std::string map_uid, bool is_arc, bool is_mile)
     }
     return 0;
 }
+
+double get_connectivity_threshold(std::string map_uid, bool is_arc, bool is_mile)
+{
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        return json_map->GetConnectivityThreshold(is_arc, is_mile);
+    }
+    return 0;
+}
+
+double get_dist_weights_nnz(std::string map_uid, double dist_thres, bool is_arc, bool is_mile)
+{
+    // check the size of the distance weights before creating them: e.g. reject
+    // a threshold that would need too much memory
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        return (double)json_map->CountDistanceNeighbors(dist_thres, is_arc, is_mile);
+    }
+    return 0;
+}
+
+bool free_weights(std::string map_uid, std::string weight_uid)
+{
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        return json_map->FreeWeights(weight_uid);
+    }
+    return false;
+}
+
+double get_weights_size(std::string map_uid, std::string weight_uid)
+{
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        return (double)json_map->GetWeightsSize(weight_uid);
+    }
+    return 0;
+}
+
+ComponentsResult weights_components(std::string map_uid, std::string weight_uid)
+{
+    ComponentsResult rst;
+    rst.is_valid = false;
+    rst.num_components = 0;
+
+    GdaGeojson *json_map = geojson_maps[map_uid];
+    if (json_map) {
+        const WeightsComponents* comp = json_map->GetWeightsComponents(weight_uid);
+        if (comp) {
+            rst.is_valid = true;
+            rst.num_components = comp->num_components;
+            rst.labels = comp->labels;
+            rst.sizes = comp->sizes;
+            rst.islands = comp->islands;
+        }
+    }
+    return rst;
+}
+
+void set_weights_cache_budget(double bytes)
+{
+    // the least recently used weights of a map are freed when its weights use
+    // more than the budget; 0 for no limit
+    WeightsCache::SetBudget(bytes > 0 ? (size_t)bytes : 0);
+}
@@ -0,0 +1,195 @@
+#ifndef JSGEODA_KDTREE_H
+#define JSGEODA_KDTREE_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/**
+ * KdTree
+ *
+ * A static kd-tree of DIM-dimensional points, bulk-built once with
+ * nth_element splits. The points are copied into tree order, so a leaf bucket
+ * is contiguous in memory.
+ *
+ * The search functions are const and keep no state in the tree, so (unlike the
+ * ANN kd-tree in libgeoda, which uses global search variables) many threads can
+ * query the same tree at the same time.
+ *
+ * Distances are squared Euclidean distances. Ties are broken by point index, so
+ * the results do not depend on the order of the queries.
+ */
+template <int DIM>
+class KdTree {
+public:
+    typedef std::pair<double, int> DistIdx; // (squared distance, point index)
+
+    // coords: n * DIM values, point i is coords[i*DIM .. i*DIM+DIM)
+    explicit KdTree(const std::vector<double>& coords, int leaf_size = 12)
+    : leaf_size(leaf_size < 1 ? 1 : leaf_size)
+    {
+        int n = (int)(coords.size() / DIM);
+        index.resize(n);
+        for (int i = 0; i < n; ++i) index[i] = i;
+        if (n > 0) {
+            nodes.reserve(2 * (n / this->leaf_size + 1));
+            Build(coords, 0, n);
+        }
+        points.resize(coords.size());
+        for (int i = 0; i < n; ++i) {
+            for (int d = 0; d < DIM; ++d) {
+                points[i * DIM + d] = coords[index[i] * DIM + d];
+            }
+        }
+    }
+
+    int Size() const { return (int)index.size(); }
+
+    /**
+     * Find the k nearest points of q (excluding the point exclude_idx, use -1
+     * to keep all points). result is sorted by (distance, index).
+     */
+    void KnnSearch(const double* q, int k, int exclude_idx, std::vector<DistIdx>& result) const
+    {
+        result.clear();
+        if (k <= 0 || nodes.empty()) return;
+        KnnSearch(0, q, k, exclude_idx, result);
+        std::sort_heap(result.begin(), result.end());
+    }
+
+    /**
+     * Call func(idx, d2) for every point within squared distance r2 of q (r2
+     * inclusive, excluding the point exclude_idx), in no particular order.
+     */
+    template <class Func>
+    void RadiusSearch(const double* q, double r2, int exclude_idx, Func& func) const
+    {
+        if (nodes.empty() || r2 < 0) return;
+        RadiusSearch(0, q, r2, exclude_idx, func);
+    }
+
+protected:
+    struct Node {
+        int start;
+        int end;
+        int split_dim; // -1 for leaf
+        double split_val;
+        int left;
+        int right;
+    };
+
+    int leaf_size;
+    std::vector<Node> nodes;
+    std::vector<int> index;     // tree order -> point index
+    std::vector<double> points; // coordinates in tree order
+
+    struct CoordLess {
+        const std::vector<double>& coords;
+        int dim;
+        CoordLess(const std::vector<double>& coords, int dim) : coords(coords), dim(dim) {}
+        bool operator()(int a, int b) const {
+            double va = coords[a * DIM + dim], vb = coords[b * DIM + dim];
+            return va < vb || (va == vb && a < b);
+        }
+    };
+
+    int Build(const std::vector<double>& coords, int start, int end)
+    {
+        int node_id = (int)nodes.size();
+        Node node = {start, end, -1, 0, -1, -1};
+        nodes.push_back(node);
+        if (end - start <= leaf_size) {
+            return node_id;
+        }
+        // split the widest dimension at the median
+        double lo[DIM], hi[DIM];
+        for (int d = 0; d < DIM; ++d) {
+            lo[d] = hi[d] = coords[index[start] * DIM + d];
+        }
+        for (int i = start + 1; i < end; ++i) {
+            for (int d = 0; d < DIM; ++d) {
+                double v = coords[index[i] * DIM + d];
+                if (v < lo[d]) lo[d] = v;
+                if (v > hi[d]) hi[d] = v;
+            }
+        }
+        int split_dim = 0;
+        for (int d = 1; d < DIM; ++d) {
+            if (hi[d] - lo[d] > hi[split_dim] - lo[split_dim]) split_dim = d;
+        }
+        int mid = start + (end - start) / 2;
+        std::nth_element(index.begin() + start, index.begin() + mid, index.begin() + end,
+                         CoordLess(coords, split_dim));
+
+        nodes[node_id].split_dim = split_dim;
+        nodes[node_id].split_val = coords[index[mid] * DIM + split_dim];
+        int left = Build(coords, start, mid);
+        int right = Build(coords, mid, end);
+        nodes[node_id].left = left;
+        nodes[node_id].right = right;
+        return node_id;
+    }
+
+    inline double Dist2(const double* q, int pos) const
+    {
+        double d2 = 0;
+        for (int d = 0; d < DIM; ++d) {
+            double diff = q[d] - points[pos * DIM + d];
+            d2 += diff * diff;
+        }
+        return d2;
+    }
+
+    void KnnSearch(int node_id, const double* q, int k, int exclude_idx, std::vector<DistIdx>& heap) const
+    {
+        const Node& node = nodes[node_id];
+        if (node.split_dim < 0) {
+            for (int pos = node.start; pos < node.end; ++pos) {
+                int idx = index[pos];
+                if (idx == exclude_idx) continue;
+                DistIdx cand(Dist2(q, pos), idx);
+                if ((int)heap.size() < k) {
+                    heap.push_back(cand);
+                    std::push_heap(heap.begin(), heap.end());
+                } else if (cand < heap.front()) {
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = cand;
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+            return;
+        }
+        double diff = q[node.split_dim] - node.split_val;
+        int near_child = diff < 0 ? node.left : node.right;
+        int far_child = diff < 0 ? node.right : node.left;
+        KnnSearch(near_child, q, k, exclude_idx, heap);
+        // <= keeps the points tied with the current k-th distance
+        if ((int)heap.size() < k || diff * diff <= heap.front().first) {
+            KnnSearch(far_child, q, k, exclude_idx, heap);
+        }
+    }
+
+    template <class Func>
+    void RadiusSearch(int node_id, const double* q, double r2, int exclude_idx, Func& func) const
+    {
+        const Node& node = nodes[node_id];
+        if (node.split_dim < 0) {
+            for (int pos = node.start; pos < node.end; ++pos) {
+                int idx = index[pos];
+                if (idx == exclude_idx) continue;
+                double d2 = Dist2(q, pos);
+                if (d2 <= r2) func(idx, d2);
+            }
+            return;
+        }
+        double diff = q[node.split_dim] - node.split_val;
+        int near_child = diff < 0 ? node.left : node.right;
+        int far_child = diff < 0 ? node.right : node.left;
+        RadiusSearch(near_child, q, r2, exclude_idx, func);
+        if (diff * diff <= r2) {
+            RadiusSearch(far_child, q, r2, exclude_idx, func);
+        }
+    }
+};
+
+#endif //JSGEODA_KDTREE_H
@@ -0,0 +1,92 @@
+#include "kernel_weights.h"
+#include "sphere.h"
+
+bool ParseKernelType(const std::string& kernel, KernelType& kernel_type)
+{
+    if (kernel == "triangular") {
+        kernel_type = KERNEL_TRIANGULAR;
+    } else if (kernel == "uniform") {
+        kernel_type = KERNEL_UNIFORM;
+    } else if (kernel == "epanechnikov") {
+        kernel_type = KERNEL_EPANECHNIKOV;
+    } else if (kernel == "quartic") {
+        kernel_type = KERNEL_QUARTIC;
+    } else if (kernel == "gaussian") {
+        kernel_type = KERNEL_GAUSSIAN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+double KernelValue(KernelType kernel_type, double z)
+{
+    switch (kernel_type) {
+        case KERNEL_TRIANGULAR:
+            return KernelFunc<KERNEL_TRIANGULAR>::Value(z);
+        case KERNEL_UNIFORM:
+            return KernelFunc<KERNEL_UNIFORM>::Value(z);
+        case KERNEL_EPANECHNIKOV:
+            return KernelFunc<KERNEL_EPANECHNIKOV>::Value(z);
+        case KERNEL_QUARTIC:
+            return KernelFunc<KERNEL_QUARTIC>::Value(z);
+        case KERNEL_GAUSSIAN:
+            return KernelFunc<KERNEL_GAUSSIAN>::Value(z);
+    }
+    return 0;
+}
+
+KernelSpec MakeKernelSpec(KernelType kernel_type, const std::vector<double>& bandwidths, bool use_kernel_diagonals,
+                          const std::vector<double>& x, const std::vector<double>& y, bool is_arc, bool is_mile)
+{
+    KernelSpec spec;
+    spec.kernel_type = kernel_type;
+    spec.bandwidths = bandwidths;
+    spec.use_kernel_diagonals = use_kernel_diagonals;
+    spec.is_arc = is_arc;
+    spec.is_mile = is_mile;
+    if (is_arc) {
+        spec.coords = LonLatToUnitVectors(x, y);
+    } else {
+        spec.coords.resize(x.size() * 3, 0);
+        for (size_t i = 0; i < x.size(); ++i) {
+            spec.coords[i * 3] = x[i];
+            spec.coords[i * 3 + 1] = y[i];
+        }
+    }
+    return spec;
+}
+
+void CSRDistancesToKernel(WeightsCSR& csr, KernelType kernel_type, const std::vector<double>& bandwidths,
+                          bool use_kernel_diagonals)
+{
+    double diagonal = use_kernel_diagonals ? KernelValue(kernel_type, 0) : 1.0;
+    bool is_adaptive = bandwidths.size() > 1;
+
+    WeightsCSR out;
+    out.num_obs = csr.num_obs;
+    out.is_symmetric = csr.is_symmetric && !is_adaptive;
+    out.offsets.resize(csr.num_obs + 1, 0);
+    out.nbrs.reserve(csr.nbrs.size() + csr.num_obs);
+    out.weights.reserve(csr.nbrs.size() + csr.num_obs);
+    for (int i = 0; i < csr.num_obs; ++i) {
+        double bandwidth = is_adaptive ? bandwidths[i] : bandwidths[0];
+        bool has_diagonal = false;
+        for (size_t j = csr.offsets[i]; j < csr.offsets[i + 1]; ++j) {
+            // keep the row sorted by id when the diagonal is inserted
+            if (!has_diagonal && csr.nbrs[j] > i) {
+                out.nbrs.push_back(i);
+                out.weights.push_back(diagonal);
+                has_diagonal = true;
+            }
+            out.nbrs.push_back(csr.nbrs[j]);
+            out.weights.push_back(bandwidth > 0 ? KernelValue(kernel_type, csr.weights[j] / bandwidth) : 0);
+        }
+        if (!has_diagonal) {
+            out.nbrs.push_back(i);
+            out.weights.push_back(diagonal);
+        }
+        out.offsets[i + 1] = out.nbrs.size();
+    }
+    csr = out;
+}
@@ -0,0 +1,102 @@
+#ifndef JSGEODA_KERNEL_WEIGHTS_H
+#define JSGEODA_KERNEL_WEIGHTS_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "weights_csr.h"
+
+enum KernelType {
+    KERNEL_TRIANGULAR,
+    KERNEL_UNIFORM,
+    KERNEL_EPANECHNIKOV,
+    KERNEL_QUARTIC,
+    KERNEL_GAUSSIAN
+};
+
+/**
+ * Parse the kernel name used in the weights API ("triangular", "uniform",
+ * "epanechnikov", "quartic", "gaussian"). Returns false for other names.
+ */
+bool ParseKernelType(const std::string& kernel, KernelType& kernel_type);
+
+/**
+ * Kernel functions of z = d / bandwidth, resolved at compile time:
+ * KernelFunc<K>::Value(z). They have no branches, so loops over the
+ * neighbors that evaluate them on the fly can be vectorized.
+ */
+template <KernelType K>
+struct KernelFunc;
+
+template <>
+struct KernelFunc<KERNEL_TRIANGULAR> {
+    static double Value(double z) { return 1.0 - z; }
+};
+
+template <>
+struct KernelFunc<KERNEL_UNIFORM> {
+    static double Value(double) { return 0.5; }
+};
+
+template <>
+struct KernelFunc<KERNEL_EPANECHNIKOV> {
+    static double Value(double z) { return 3.0 / 4.0 * (1.0 - z * z); }
+};
+
+template <>
+struct KernelFunc<KERNEL_QUARTIC> {
+    static double Value(double z) { return 15.0 / 16.0 * (1.0 - z * z) * (1.0 - z * z); }
+};
+
+template <>
+struct KernelFunc<KERNEL_GAUSSIAN> {
+    static double Value(double z) { return std::exp(-z * z / 2.0) / std::sqrt(2.0 * M_PI); }
+};
+
+/**
+ * Kernel function of z = d / bandwidth
+ */
+double KernelValue(KernelType kernel_type, double z);
+
+/**
+ * KernelSpec
+ *
+ * Everything needed to evaluate kernel weights on the fly instead of storing
+ * them (implicit kernel weights): the weight of neighbor j in row i is
+ * K(d(i, j) / bandwidth_i), and the weight of i itself is GetDiagonal().
+ *
+ * coords are the centroids as 3D points, (x, y, 0) for planar distances or
+ * unit vectors for arc distances (d is then the arc distance of the chord),
+ * so d is computed exactly as when the weights were created.
+ */
+struct KernelSpec {
+    KernelType kernel_type;
+    std::vector<double> bandwidths; // one (fixed) or one per observation (adaptive)
+    bool use_kernel_diagonals;
+    bool is_arc;
+    bool is_mile;
+    std::vector<double> coords;     // n * 3
+
+    KernelSpec() : kernel_type(KERNEL_TRIANGULAR), use_kernel_diagonals(false), is_arc(false), is_mile(false) {}
+
+    int GetNumObs() const { return (int)(coords.size() / 3); }
+
+    double GetDiagonal() const { return use_kernel_diagonals ? KernelValue(kernel_type, 0) : 1.0; }
+};
+
+KernelSpec MakeKernelSpec(KernelType kernel_type, const std::vector<double>& bandwidths, bool use_kernel_diagonals,
+                          const std::vector<double>& x, const std::vector<double>& y, bool is_arc, bool is_mile);
+
+/**
+ * Turn the neighbor distances stored in csr.weights into kernel weights
+ * K(d / bandwidth), and add each observation to its own neighbors (the
+ * diagonal). The diagonal weight is K(0) if use_kernel_diagonals, otherwise 1.
+ *
+ * bandwidths holds one value (fixed bandwidth), or one value per observation
+ * (adaptive bandwidth).
+ */
+void CSRDistancesToKernel(WeightsCSR& csr, KernelType kernel_type, const std::vector<double>& bandwidths,
+                          bool use_kernel_diagonals);
+
+#endif //JSGEODA_KERNEL_WEIGHTS_H
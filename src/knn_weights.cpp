@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+
+#include "hilbert.h"
+#include "kdtree.h"
+#include "parallel.h"
+#include "sphere.h"
+#include "knn_weights.h"
+
+namespace {
+
+    // run the knn queries of all points of the tree, in query_order, and
+    // store the squared distances
+    template <int DIM>
+    KnnNeighbors knn_search(const std::vector<double>& coords, const std::vector<int>& query_order,
+                            unsigned int k, int n_threads)
+    {
+        KnnNeighbors knn;
+        int num_obs = (int)(coords.size() / DIM);
+        knn.num_obs = num_obs;
+        knn.k = num_obs > 0 ? (int)std::min<unsigned int>(k, num_obs - 1) : 0;
+        if (knn.k == 0) return knn;
+
+        KdTree<DIM> tree(coords);
+        knn.nbrs.resize((size_t)num_obs * knn.k);
+        knn.dists.resize((size_t)num_obs * knn.k);
+        gda_parallel_for(num_obs, n_threads, [&](size_t start, size_t end, int) {
+            std::vector<typename KdTree<DIM>::DistIdx> result;
+            for (size_t pos = start; pos < end; ++pos) {
+                int i = query_order[pos];
+                tree.KnnSearch(&coords[(size_t)i * DIM], knn.k, i, result);
+                size_t row = (size_t)i * knn.k;
+                for (int j = 0; j < knn.k; ++j) {
+                    knn.nbrs[row + j] = result[j].second;
+                    knn.dists[row + j] = result[j].first;
+                }
+            }
+        });
+        return knn;
+    }
+}
+
+KnnNeighbors KnnSearchAll(const std::vector<double>& x, const std::vector<double>& y, unsigned int k,
+                          int n_threads)
+{
+    int num_obs = (int)x.size();
+    std::vector<double> coords(num_obs * 2);
+    for (int i = 0; i < num_obs; ++i) {
+        coords[i * 2] = x[i];
+        coords[i * 2 + 1] = y[i];
+    }
+    KnnNeighbors knn = knn_search<2>(coords, HilbertOrder(x, y), k, n_threads);
+    for (size_t j = 0; j < knn.dists.size(); ++j) {
+        knn.dists[j] = std::sqrt(knn.dists[j]);
+    }
+    return knn;
+}
+
+KnnNeighbors KnnSearchAllArc(const std::vector<double>& lon, const std::vector<double>& lat, unsigned int k,
+                             bool is_mile, int n_threads)
+{
+    std::vector<double> coords = LonLatToUnitVectors(lon, lat);
+    KnnNeighbors knn = knn_search<3>(coords, HilbertOrder(lon, lat), k, n_threads);
+    for (size_t j = 0; j < knn.dists.size(); ++j) {
+        knn.dists[j] = ChordToArcDistance(std::sqrt(knn.dists[j]), is_mile);
+    }
+    return knn;
+}
+
+WeightsCSR KnnToCSR(const KnnNeighbors& knn, double power, bool is_inverse)
+{
+    WeightsCSR csr;
+    csr.num_obs = knn.num_obs;
+    csr.is_symmetric = false;
+    csr.offsets.resize(knn.num_obs + 1);
+    for (int i = 0; i <= knn.num_obs; ++i) {
+        csr.offsets[i] = (size_t)i * knn.k;
+    }
+    csr.nbrs.assign(knn.nbrs.begin(), knn.nbrs.end());
+    csr.weights.assign(knn.dists.begin(), knn.dists.end());
+    CSRDistancesToWeights(csr, power, is_inverse);
+    return csr;
+}
+
+KnnNeighbors KnnPrefix(const KnnNeighbors& knn, unsigned int k)
+{
+    if ((int)k >= knn.k) return knn;
+
+    KnnNeighbors prefix;
+    prefix.num_obs = knn.num_obs;
+    prefix.k = (int)k;
+    prefix.nbrs.resize((size_t)knn.num_obs * k);
+    prefix.dists.resize((size_t)knn.num_obs * k);
+    for (int i = 0; i < knn.num_obs; ++i) {
+        size_t src = (size_t)i * knn.k, dst = (size_t)i * k;
+        std::copy(knn.nbrs.begin() + src, knn.nbrs.begin() + src + k, prefix.nbrs.begin() + dst);
+        std::copy(knn.dists.begin() + src, knn.dists.begin() + src + k, prefix.dists.begin() + dst);
+    }
+    return prefix;
+}
+
+std::vector<double> KnnBandwidths(const KnnNeighbors& knn, bool adaptive_bandwidth)
+{
+    // the k-th neighbor distance is the last of each row
+    std::vector<double> bandwidths(adaptive_bandwidth ? knn.num_obs : 1, 0);
+    for (int i = 0; i < knn.num_obs && knn.k > 0; ++i) {
+        double kth_dist = knn.dists[(size_t)i * knn.k + knn.k - 1];
+        if (adaptive_bandwidth) {
+            bandwidths[i] = kth_dist;
+        } else {
+            bandwidths[0] = std::max(bandwidths[0], kth_dist);
+        }
+    }
+    return bandwidths;
+}
+
+WeightsCSR KnnToKernelCSR(const KnnNeighbors& knn, KernelType kernel_type, bool adaptive_bandwidth,
+                          bool use_kernel_diagonals)
+{
+    WeightsCSR csr;
+    csr.num_obs = knn.num_obs;
+    csr.is_symmetric = false;
+    csr.offsets.resize(knn.num_obs + 1);
+    for (int i = 0; i <= knn.num_obs; ++i) {
+        csr.offsets[i] = (size_t)i * knn.k;
+    }
+    csr.nbrs.assign(knn.nbrs.begin(), knn.nbrs.end());
+    csr.weights.assign(knn.dists.begin(), knn.dists.end());
+
+    CSRSortRows(csr, 1);
+    CSRDistancesToKernel(csr, kernel_type, KnnBandwidths(knn, adaptive_bandwidth), use_kernel_diagonals);
+    return csr;
+}
+
+WeightsCSR FillIslandsWithKnn(const WeightsCSR& csr, const std::vector<double>& x, const std::vector<double>& y,
+                              unsigned int k)
+{
+    int num_obs = csr.num_obs;
+    std::vector<int> islands, others;
+    for (int i = 0; i < num_obs; ++i) {
+        bool is_island = true;
+        for (size_t j = csr.offsets[i]; j < csr.offsets[i + 1]; ++j) {
+            if (csr.nbrs[j] != i) is_island = false;
+        }
+        if (is_island) {
+            islands.push_back(i);
+        } else {
+            others.push_back(i);
+        }
+    }
+    int n_nbrs = (int)std::min<size_t>(k, others.size());
+    if (islands.empty() || n_nbrs == 0) return csr;
+
+    // kd-tree of the non-island points only
+    std::vector<double> coords(others.size() * 2);
+    for (size_t p = 0; p < others.size(); ++p) {
+        coords[p * 2] = x[others[p]];
+        coords[p * 2 + 1] = y[others[p]];
+    }
+    KdTree<2> tree(coords);
+
+    std::vector<std::vector<long> > added(num_obs);
+    std::vector<KdTree<2>::DistIdx> result;
+    for (size_t m = 0; m < islands.size(); ++m) {
+        int i = islands[m];
+        double q[2] = {x[i], y[i]};
+        tree.KnnSearch(q, n_nbrs, -1, result);
+        for (size_t r = 0; r < result.size(); ++r) {
+            int j = others[result[r].second];
+            added[i].push_back(j);
+            added[j].push_back(i);
+        }
+    }
+
+    WeightsCSR filled;
+    filled.num_obs = num_obs;
+    filled.is_symmetric = csr.is_symmetric;
+    filled.offsets.resize(num_obs + 1, 0);
+    filled.nbrs.reserve(csr.nbrs.size() + 2 * islands.size() * n_nbrs);
+    std::vector<long> row;
+    for (int i = 0; i < num_obs; ++i) {
+        row.assign(csr.nbrs.begin() + csr.offsets[i], csr.nbrs.begin() + csr.offsets[i + 1]);
+        if (!added[i].empty()) {
+            row.insert(row.end(), added[i].begin(), added[i].end());
+            std::sort(row.begin(), row.end());
+            row.erase(std::unique(row.begin(), row.end()), row.end());
+        }
+        filled.nbrs.insert(filled.nbrs.end(), row.begin(), row.end());
+        filled.offsets[i + 1] = filled.nbrs.size();
+    }
+    return filled;
+}
@@ -0,0 +1,84 @@
+#ifndef JSGEODA_KNN_WEIGHTS_H
+#define JSGEODA_KNN_WEIGHTS_H
+
+#include <vector>
+
+#include "kernel_weights.h"
+#include "weights_csr.h"
+
+/**
+ * KnnNeighbors
+ *
+ * The k nearest neighbors of every observation, sorted by (distance, id): the
+ * neighbors of observation i are nbrs[i*k .. i*k+k), and dists holds their
+ * distances.
+ */
+struct KnnNeighbors {
+    int num_obs;
+    int k;
+    std::vector<int> nbrs;
+    std::vector<double> dists;
+
+    KnnNeighbors() : num_obs(0), k(0) {}
+};
+
+/**
+ * Find the k nearest neighbors of all points (x, y).
+ *
+ * The kd-tree is bulk-built once, then the n queries are run in parallel
+ * blocks. The queries are sorted along a Hilbert curve first, so consecutive
+ * queries of a thread visit the same parts of the tree. k is capped to n-1.
+ */
+KnnNeighbors KnnSearchAll(const std::vector<double>& x, const std::vector<double>& y, unsigned int k,
+                          int n_threads);
+
+/**
+ * Find the k nearest neighbors of all points (lon, lat) by great-circle
+ * distance. The points are converted to 3D unit vectors and searched by chord
+ * distance; only the reported distances are converted to km (or miles if
+ * is_mile).
+ */
+KnnNeighbors KnnSearchAllArc(const std::vector<double>& lon, const std::vector<double>& lat, unsigned int k,
+                             bool is_mile, int n_threads);
+
+/**
+ * The first k neighbors of every observation (k <= knn.k). The neighbors are
+ * sorted by (distance, id), so this is the same as searching with k directly:
+ * one search with the largest k serves every smaller k.
+ */
+KnnNeighbors KnnPrefix(const KnnNeighbors& knn, unsigned int k);
+
+/**
+ * Create KNN weights from the nearest neighbors: binary weights, or inverse
+ * distance weights 1/d^power if is_inverse.
+ */
+WeightsCSR KnnToCSR(const KnnNeighbors& knn, double power, bool is_inverse);
+
+/**
+ * Bandwidths of kernel weights from the nearest neighbors: the k-th neighbor
+ * distance of each observation if adaptive_bandwidth, otherwise one value,
+ * the largest k-th neighbor distance.
+ */
+std::vector<double> KnnBandwidths(const KnnNeighbors& knn, bool adaptive_bandwidth);
+
+/**
+ * Create kernel weights from the nearest neighbors: K(d / bandwidth), where
+ * the bandwidth is the k-th neighbor distance of each observation if
+ * adaptive_bandwidth, otherwise the largest k-th neighbor distance. The rows
+ * are sorted by id and include the diagonal (see CSRDistancesToKernel()).
+ */
+WeightsCSR KnnToKernelCSR(const KnnNeighbors& knn, KernelType kernel_type, bool adaptive_bandwidth,
+                          bool use_kernel_diagonals);
+
+/**
+ * Connect the islands of binary weights (rows without neighbors other than
+ * the diagonal) to their k nearest non-island points (x, y).
+ *
+ * The kd-tree is built over the non-island points only, and queried once per
+ * island. Each new pair is added in both directions, so symmetric weights
+ * stay symmetric. The rows of the result are sorted by id.
+ */
+WeightsCSR FillIslandsWithKnn(const WeightsCSR& csr, const std::vector<double>& x, const std::vector<double>& y,
+                              unsigned int k);
+
+#endif //JSGEODA_KNN_WEIGHTS_H
@@ -0,0 +1,1225 @@
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <map>
+
+#include "lisa_engine.h"
+#include "lisa_kernels.h"
+#include "parallel.h"
+#include "philox.h"
+#include "spatial_lag.h"
+
+namespace {
+
+    // the counters of the random numbers: (block, permutation, observation,
+    // stream). The draws of one observation and permutation are a function of
+    // (seed, file id, permutation) alone, so any subset of them can be computed
+    // on any thread
+    const uint32_t COMPLETE_STREAM = 0;
+    const uint32_t LOOKUP_STREAM = 1;
+
+    /**
+     * Draws nn distinct random positions of [0, range) in random order, by a
+     * partial Fisher-Yates shuffle that is undone after each draw, so every
+     * draw costs O(nn) whatever the range.
+     */
+    class Shuffler {
+    public:
+        explicit Shuffler(int range) : idx(range > 0 ? range : 0)
+        {
+            for (int k = 0; k < (int)idx.size(); ++k) idx[k] = k;
+        }
+
+        void Draw(PhiloxStream& rng, int nn, int* out)
+        {
+            int range = (int)idx.size();
+            swaps.resize(nn);
+            for (int k = 0; k < nn; ++k) {
+                int r = k + rng.NextInt(range - k);
+                std::swap(idx[k], idx[r]);
+                swaps[k] = r;
+                out[k] = idx[k];
+            }
+            for (int k = nn - 1; k >= 0; --k) {
+                std::swap(idx[k], idx[swaps[k]]);
+            }
+        }
+
+    protected:
+        std::vector<int> idx;
+        std::vector<int> swaps;
+    };
+
+    // the defined neighbors of an observation (without itself) and their
+    // weights, plus the weight of the observation itself
+    struct NbrRow {
+        std::vector<int> nbrs;
+        std::vector<double> wts;
+        double self_wt;
+    };
+
+    const char* MORAN_LABELS[] = {"Not significant", "High-High", "Low-Low", "Low-High", "High-Low", "Undefined",
+                                  "Isolated"};
+    const char* MORAN_COLORS[] = {"#eeeeee", "#FF0000", "#0000FF", "#a7adf9", "#f4ada8", "#464646", "#999999"};
+
+    const char* G_LABELS[] = {"Not significant", "High-High", "Low-Low", "Undefined", "Isolated"};
+    const char* G_COLORS[] = {"#eeeeee", "#FF0000", "#0000FF", "#464646", "#999999"};
+
+    const char* GEARY_LABELS[] = {"Not significant", "High-High", "Low-Low", "Other Positive", "Negative",
+                                  "Undefined", "Isolated"};
+    const char* GEARY_COLORS[] = {"#eeeeee", "#b2182b", "#ef8a62", "#fddbc7", "#67adc7", "#464646", "#999999"};
+
+    const char* MULTI_GEARY_LABELS[] = {"Not significant", "Positive", "Negative", "Undefined", "Isolated"};
+    const char* MULTI_GEARY_COLORS[] = {"#eeeeee", "#33a02c", "#a6cee3", "#464646", "#999999"};
+
+    const char* JOINCOUNT_LABELS[] = {"Not significant", "Significant", "Undefined", "Isolated"};
+    const char* JOINCOUNT_COLORS[] = {"#eeeeee", "#348124", "#464646", "#999999"};
+
+    int sig_category(double p)
+    {
+        if (p <= 0.0001) return 4;
+        if (p <= 0.001) return 3;
+        if (p <= 0.01) return 2;
+        if (p <= 0.05) return 1;
+        return 0;
+    }
+
+    // sum, sum of squares and number of the defined values of a variable
+    struct PoolMoments {
+        double sum;
+        double sum_sq;
+        int count;
+    };
+
+    /**
+     * Mean and variance of sum_k w_k Y_k under conditional randomization: the
+     * Y_k are drawn without replacement from the values of the pool other than
+     * xi (n = count - 1 values, mean mu and variance s2), so
+     * E = mu sum_k w_k and Var = s2 (n sum_k w_k^2 - (sum_k w_k)^2) / (n - 1)
+     */
+    void randomization_moments(const NbrRow& row, double xi, const PoolMoments& pool, double& mean, double& var)
+    {
+        int n = pool.count - 1;
+        double mu = n > 0 ? (pool.sum - xi) / n : 0;
+        double s2 = n > 0 ? std::max(0.0, (pool.sum_sq - xi * xi) / n - mu * mu) : 0;
+        double w1 = 0, w2 = 0;
+        for (size_t k = 0; k < row.wts.size(); ++k) {
+            w1 += row.wts[k];
+            w2 += row.wts[k] * row.wts[k];
+        }
+        mean = mu * w1;
+        var = n > 1 ? std::max(0.0, s2 * (n * w2 - w1 * w1) / (n - 1)) : 0;
+    }
+
+    /**
+     * The statistics. Each one has:
+     *
+     * ROW_STANDARDIZED: the weights of a row are divided by their sum
+     * BINARY: the weight values are ignored (1 for every neighbor)
+     * TWO_SIDED: p counts the smaller tail of the permutations
+     *
+     * WithSelf(): the weight of i itself is part of the row (G*)
+     * Observed(i, row, lag): the statistic of i, and its spatial lag
+     * Permuted(i, sample, row): the statistic of i with the neighbors sample
+     * NeedsPermutation(i, stat): false if p is 1 anyway
+     * Analytic(i, row, mean, sd): the mean and standard deviation of the
+     * statistic of i under randomization, false if there is no closed form
+     * Cluster(i, stat, lag, count, used): the cluster of a significant i,
+     * where count of the used permutations are >= stat
+     */
+
+    struct MoranStat {
+        static const bool ROW_STANDARDIZED = true;
+        static const bool BINARY = false;
+        static const bool TWO_SIDED = true;
+
+        const double* z;
+        PoolMoments moments;
+
+        bool WithSelf() const { return false; }
+
+        double Observed(int i, const NbrRow& row, double& lag) const
+        {
+            lag = GatherDot(z, row.nbrs.data(), row.wts.data(), (int)row.nbrs.size());
+            return z[i] * lag;
+        }
+
+        bool Analytic(int i, const NbrRow& row, double& mean, double& sd) const
+        {
+            double var;
+            randomization_moments(row, z[i], moments, mean, var);
+            mean *= z[i];
+            sd = std::fabs(z[i]) * std::sqrt(var);
+            return true;
+        }
+
+        double Permuted(int i, const int* sample, const NbrRow& row) const
+        {
+            return z[i] * GatherDot(z, sample, row.wts.data(), (int)row.nbrs.size());
+        }
+
+        bool NeedsPermutation(int, double) const { return true; }
+
+        int Cluster(int i, double, double lag, int, int) const { return Quadrant(z[i], lag); }
+
+        static int Quadrant(double zi, double lag)
+        {
+            if (zi > 0 && lag > 0) return 1;
+            if (zi < 0 && lag < 0) return 2;
+            if (zi < 0 && lag > 0) return 3;
+            return 4;
+        }
+    };
+
+    struct GStat {
+        static const bool ROW_STANDARDIZED = true;
+        static const bool BINARY = false;
+        static const bool TWO_SIDED = true;
+
+        const double* x;
+        double denom;    // sum of x over the defined observations
+        double expected; // mean G: 1 / (n - 1), or 1 / n for G*
+        bool is_gstar;
+        PoolMoments moments;
+
+        bool WithSelf() const { return is_gstar; }
+
+        double sum_others(int i) const { return is_gstar ? denom : denom - x[i]; }
+
+        double lag_of(int i, const int* nbrs, const NbrRow& row) const
+        {
+            double lag = GatherDot(x, nbrs, row.wts.data(), (int)row.nbrs.size());
+            return is_gstar ? lag + row.self_wt * x[i] : lag;
+        }
+
+        double Observed(int i, const NbrRow& row, double& lag) const
+        {
+            lag = this->lag_of(i, row.nbrs.data(), row);
+            double d = sum_others(i);
+            return d != 0 ? lag / d : 0;
+        }
+
+        double Permuted(int i, const int* sample, const NbrRow& row) const
+        {
+            double d = sum_others(i);
+            return d != 0 ? this->lag_of(i, sample, row) / d : 0;
+        }
+
+        bool Analytic(int i, const NbrRow& row, double& mean, double& sd) const
+        {
+            double d = sum_others(i), var;
+            randomization_moments(row, x[i], moments, mean, var);
+            if (is_gstar) mean += row.self_wt * x[i];
+            mean = d != 0 ? mean / d : 0;
+            sd = d != 0 ? std::sqrt(var) / std::fabs(d) : 0;
+            return true;
+        }
+
+        bool NeedsPermutation(int, double) const { return true; }
+
+        int Cluster(int, double g, double, int, int) const { return g > expected ? 1 : 2; }
+    };
+
+    struct GearyStat {
+        static const bool ROW_STANDARDIZED = true;
+        static const bool BINARY = false;
+        static const bool TWO_SIDED = true;
+
+        const double* z;
+
+        bool WithSelf() const { return false; }
+
+        double Observed(int i, const NbrRow& row, double& lag) const
+        {
+            lag = GatherDot(z, row.nbrs.data(), row.wts.data(), (int)row.nbrs.size());
+            return this->Permuted(i, row.nbrs.data(), row);
+        }
+
+        double Permuted(int i, const int* sample, const NbrRow& row) const
+        {
+            return GatherSqDiff(z, sample, row.wts.data(), (int)row.nbrs.size(), z[i]);
+        }
+
+        bool Analytic(int, const NbrRow&, double&, double&) const { return false; }
+
+        bool NeedsPermutation(int, double) const { return true; }
+
+        int Cluster(int i, double, double lag, int count, int permutations) const
+        {
+            // large Geary (most permutations are smaller): negative association.
+            // A tie is positive, as in libgeoda
+            if (2 * count < permutations) return 4;
+            // small Geary (most permutations are larger): positive association
+            if (z[i] > 0 && lag > 0) return 1;
+            if (z[i] < 0 && lag < 0) return 2;
+            return 3;
+        }
+    };
+
+    struct MultiGearyStat {
+        static const bool ROW_STANDARDIZED = true;
+        static const bool BINARY = false;
+        static const bool TWO_SIDED = true;
+
+        std::vector<const double*> z; // one standardized column per variable
+
+        bool WithSelf() const { return false; }
+
+        // no spatial lag of several variables
+        double Observed(int i, const NbrRow& row, double& lag) const
+        {
+            lag = 0;
+            return this->Permuted(i, row.nbrs.data(), row);
+        }
+
+        double Permuted(int i, const int* sample, const NbrRow& row) const
+        {
+            double geary = 0;
+            for (size_t v = 0; v < z.size(); ++v) {
+                geary += GatherSqDiff(z[v], sample, row.wts.data(), (int)row.nbrs.size(), z[v][i]);
+            }
+            return z.empty() ? 0 : geary / z.size();
+        }
+
+        bool Analytic(int, const NbrRow&, double&, double&) const { return false; }
+
+        bool NeedsPermutation(int, double) const { return true; }
+
+        int Cluster(int, double, double, int count, int permutations) const
+        {
+            return 2 * count > permutations ? 1 : 2;
+        }
+    };
+
+    struct JoinCountStat {
+        static const bool ROW_STANDARDIZED = false;
+        static const bool BINARY = true;
+        static const bool TWO_SIDED = false;
+
+        // x and the data of the neighbors (x again, or y of the bivariate
+        // join count x_i sum_j w_ij y_j) packed 64 to a word, in the order of
+        // the weights: a gather of random neighbors reads n / 8 bytes instead
+        // of 8 n
+        const uint64_t* bits;
+        const uint64_t* nbr_bits;
+
+        int X(int j) const { return (int)((bits[j >> 6] >> (j & 63)) & 1); }
+
+        int Y(int j) const { return (int)((nbr_bits[j >> 6] >> (j & 63)) & 1); }
+
+        bool WithSelf() const { return false; }
+
+        double Observed(int i, const NbrRow& row, double& lag) const
+        {
+            int joins = 0;
+            for (size_t k = 0; k < row.nbrs.size(); ++k) joins += this->Y(row.nbrs[k]);
+            lag = joins;
+            return this->X(i) * joins;
+        }
+
+        double Permuted(int i, const int* sample, const NbrRow& row) const
+        {
+            int joins = 0;
+            for (size_t k = 0; k < row.nbrs.size(); ++k) joins += this->Y(sample[k]);
+            return this->X(i) * joins;
+        }
+
+        // with x_i = 0 or no joins, every permutation is >= the statistic
+        bool Analytic(int, const NbrRow&, double&, double&) const { return false; }
+
+        bool NeedsPermutation(int i, double jc) const { return this->X(i) != 0 && jc > 0; }
+
+        int Cluster(int, double, double, int, int) const { return 1; }
+    };
+
+    /**
+     * LisaRunner
+     *
+     * The observations in the order of the weights, the pool of defined
+     * observations the random neighbors are drawn from, and the loop of the
+     * permutation test shared by all statistics.
+     */
+    class LisaRunner {
+    public:
+        LisaRunner(LagWeights& w, const std::vector<bool>& undefs_in, const LisaParams& params)
+        : w(w), params(params), philox(params.last_seed_used), num_obs(w.GetNumObs())
+        {
+            const SpatialOrder& so = w.GetSpatialOrder();
+            undefs.resize(num_obs, 0);
+            file_ids.resize(num_obs);
+            pool_pos.resize(num_obs, -1);
+            for (int i = 0; i < num_obs; ++i) {
+                file_ids[i] = so.IsEmpty() ? i : so.order[i];
+                if (file_ids[i] < (int)undefs_in.size() && undefs_in[file_ids[i]]) undefs[i] = 1;
+            }
+            // the pool is in file order, so the random neighbors do not
+            // depend on the spatial order
+            for (int f = 0; f < num_obs; ++f) {
+                int i = so.IsEmpty() ? f : so.rank[f];
+                if (!undefs[i]) {
+                    pool_pos[i] = (int)pool.size();
+                    pool.push_back(i);
+                }
+            }
+        }
+
+        // values of the observations in file order -> in the order of the weights
+        std::vector<double> ToInternal(const std::vector<double>& values) const
+        {
+            std::vector<double> result(num_obs, 0);
+            for (int i = 0; i < num_obs; ++i) {
+                if (file_ids[i] < (int)values.size()) result[i] = values[file_ids[i]];
+            }
+            return result;
+        }
+
+        // a mask in file order -> bits in the order of the weights
+        std::vector<uint64_t> ToInternalBits(const BitMask& mask) const
+        {
+            std::vector<uint64_t> bits((num_obs + 63) / 64, 0);
+            for (int i = 0; i < num_obs; ++i) {
+                int f = file_ids[i];
+                if ((f >> 5) < (int)mask.size() && ((mask[f >> 5] >> (f & 31)) & 1)) {
+                    bits[i >> 6] |= (uint64_t)1 << (i & 63);
+                }
+            }
+            return bits;
+        }
+
+        // sum of the defined values, in file order
+        double SumDefined(const std::vector<double>& values) const
+        {
+            double sum = 0;
+            for (size_t p = 0; p < pool.size(); ++p) sum += values[pool[p]];
+            return sum;
+        }
+
+        int GetPoolSize() const { return (int)pool.size(); }
+
+        PoolMoments GetMoments(const std::vector<double>& values) const
+        {
+            PoolMoments moments = {0, 0, (int)pool.size()};
+            for (size_t p = 0; p < pool.size(); ++p) {
+                moments.sum += values[pool[p]];
+                moments.sum_sq += values[pool[p]] * values[pool[p]];
+            }
+            return moments;
+        }
+
+        // mean and sample standard deviation of the defined values -> z-scores
+        std::vector<double> Standardize(const std::vector<double>& values) const
+        {
+            double sum = this->SumDefined(values);
+            double mean = pool.empty() ? 0 : sum / pool.size();
+            double ssum = 0;
+            for (size_t p = 0; p < pool.size(); ++p) {
+                double d = values[pool[p]] - mean;
+                ssum += d * d;
+            }
+            double sd = pool.size() > 1 ? std::sqrt(ssum / (pool.size() - 1)) : 0;
+            std::vector<double> z(num_obs, 0);
+            for (size_t p = 0; p < pool.size(); ++p) {
+                int i = pool[p];
+                z[i] = sd > 0 ? (values[i] - mean) / sd : 0;
+            }
+            return z;
+        }
+
+        template <class Stat>
+        LisaOutput Run(const Stat& stat, const char** labels, const char** colors, int num_labels);
+
+        // the observations (in the order of the weights) with a defined
+        // neighbor marked
+        std::vector<unsigned char> RowsWithNeighborIn(const std::vector<unsigned char>& marked);
+
+        // Run() takes the permutation counts of prev (in file order) for the
+        // observations not marked in rerun (in the order of the weights)
+        void KeepCounts(const LisaOutput& prev, const std::vector<unsigned char>& rerun);
+
+        // local Moran of m standardized variables, z[i * m + v] for observation
+        // i (in the order of the weights) and variable v, in one pass: each
+        // random sample is drawn once and used for all the variables
+        std::vector<LisaOutput> RunMoranBatch(const std::vector<double>& z, int m);
+
+    protected:
+        LagWeights& w;
+        LisaParams params;
+        Philox4x32 philox;
+        int num_obs;
+        std::vector<unsigned char> undefs;
+        std::vector<int> file_ids;  // position in the weights -> file id
+        std::vector<int> pool;      // the defined observations
+        std::vector<int> pool_pos;  // observation -> position in pool, -1 if undefined
+
+        // the lookup table, 0 for the complete method
+        std::shared_ptr<const PermutationTable> table;
+
+        // see KeepCounts: -1 (or empty) for the observations to permute
+        std::vector<int> kept_counts;
+        std::vector<int> kept_used;
+
+        void loadTable();
+
+        LisaOutput makeOutput(const char** labels, const char** colors, int num_labels) const;
+
+        void toFileOrder(LisaOutput& out) const;
+
+        // neighbors by file id, so the weights are paired with the random
+        // neighbors (and summed) in the same order with any spatial order
+        void sortRow(NbrRow& row, std::vector<std::pair<int, double> >& entries) const;
+
+        // the defined neighbors of i (sorted by file id) and their weights, 1 if
+        // binary, divided by the row sum if row_standardized
+        template <class Rows, class Values>
+        void loadRow(int i, const Rows& rows, const Values& values, bool binary, bool row_standardized,
+                     bool with_self, NbrRow& row, std::vector<std::pair<int, double> >& sort_buf) const;
+
+        // the nn random neighbors of i in permutation perm, into sample
+        void drawSample(int i, int perm, int nn, Shuffler& shuffler, std::vector<int>& sample) const;
+
+        // the tail count at which i is not significant whatever the remaining
+        // permutations give: the end of the early stopping
+        int stopTail() const;
+
+        // pseudo p-value and category of i from the number of permutations >=
+        // the statistic (count of used); true if significant
+        bool setSignificance(int i, int count, int used, bool two_sided, LisaOutput& out) const;
+
+        // p-value and category of i; true if significant
+        bool setPValue(int i, double p, LisaOutput& out) const;
+
+        // the cluster of i if significant (kept for Recategorize)
+        void setCluster(int i, int cluster, bool significant, LisaOutput& out) const
+        {
+            out.sig_clusters[i] = cluster;
+            if (significant) out.clusters[i] = cluster;
+        }
+
+        // p-value of the normal approximation, one-sided in the direction of
+        // the statistic (as the pseudo p-value of the smaller tail)
+        bool setAnalytic(int i, double stat, double mean, double sd, LisaOutput& out) const;
+
+        template <class Stat, class Rows, class Values>
+        void runRange(const Stat& stat, const Rows& rows, const Values& values, size_t start, size_t end,
+                      LisaOutput& out);
+
+        // the spatial lags of the m variables with neighbors nbrs, summed in the
+        // lanes of GatherDot (see lisa_kernels.h) so they match LocalMoran
+        void batchLag(const std::vector<double>& z, int m, const int* nbrs, const NbrRow& row,
+                      std::vector<double>& lanes, std::vector<double>& lag) const;
+
+        template <class Rows, class Values>
+        void runMoranBatchRange(const std::vector<double>& z, int m, const Rows& rows, const Values& values,
+                                size_t start, size_t end, std::vector<LisaOutput>& outs);
+    };
+
+    void LisaRunner::sortRow(NbrRow& row, std::vector<std::pair<int, double> >& entries) const
+    {
+        size_t nn = row.nbrs.size();
+        entries.resize(nn);
+        for (size_t k = 0; k < nn; ++k) {
+            entries[k] = std::make_pair(file_ids[row.nbrs[k]], row.wts[k]);
+        }
+        std::sort(entries.begin(), entries.end());
+        const SpatialOrder& so = w.GetSpatialOrder();
+        for (size_t k = 0; k < nn; ++k) {
+            row.nbrs[k] = so.IsEmpty() ? entries[k].first : so.rank[entries[k].first];
+            row.wts[k] = entries[k].second;
+        }
+    }
+
+    template <class Rows, class Values>
+    void LisaRunner::loadRow(int i, const Rows& rows, const Values& values, bool binary, bool row_standardized,
+                             bool with_self, NbrRow& row, std::vector<std::pair<int, double> >& sort_buf) const
+    {
+        row.nbrs.clear();
+        row.wts.clear();
+        row.self_wt = 1.0;
+        for (typename Rows::Cursor c = rows.Row(i); c.Next();) {
+            int j = (int)c.Nbr();
+            if (j == i) {
+                row.self_wt = binary ? 1.0 : values(i, c);
+            } else if (!undefs[j]) {
+                row.nbrs.push_back(j);
+                row.wts.push_back(binary ? 1.0 : values(i, c));
+            }
+        }
+        this->sortRow(row, sort_buf);
+        int nn = (int)row.nbrs.size();
+        if (row_standardized && nn > 0) {
+            double sum = with_self ? row.self_wt : 0;
+            for (int k = 0; k < nn; ++k) sum += row.wts[k];
+            if (sum != 0) {
+                for (int k = 0; k < nn; ++k) row.wts[k] /= sum;
+                row.self_wt /= sum;
+            }
+        }
+    }
+
+    void LisaRunner::drawSample(int i, int perm, int nn, Shuffler& shuffler, std::vector<int>& sample) const
+    {
+        sample.resize(nn);
+        const int* draw;
+        if (table) {
+            draw = table->positions.data() + (size_t)perm * table->width;
+        } else {
+            PhiloxStream rng(philox, (uint32_t)perm, (uint32_t)file_ids[i], COMPLETE_STREAM);
+            shuffler.Draw(rng, nn, &sample[0]);
+            draw = &sample[0];
+        }
+        // positions in the pool without i -> observations
+        int pos_i = pool_pos[i];
+        for (int k = 0; k < nn; ++k) {
+            int p = draw[k];
+            sample[k] = pool[p >= pos_i ? p + 1 : p];
+        }
+    }
+
+    int LisaRunner::stopTail() const
+    {
+        int permutations = params.permutations;
+        if (!params.early_stopping) return permutations + 1;
+        // the smallest tail with p > cutoff, computed as in setSignificance
+        int tail = std::max(0, (int)(params.significance_cutoff * (permutations + 1.0)) - 1);
+        while (tail <= permutations && (tail + 1.0) / (permutations + 1.0) <= params.significance_cutoff) ++tail;
+        return tail;
+    }
+
+    bool LisaRunner::setSignificance(int i, int count, int used, bool two_sided, LisaOutput& out) const
+    {
+        int tail = count;
+        if (two_sided && used - count < count) tail = used - count;
+        // stopped early: the sequential p-value of Besag and Clifford, over
+        // the cutoff since used <= permutations
+        double p = (tail + 1.0) / (used + 1.0);
+        return this->setPValue(i, p, out);
+    }
+
+    bool LisaRunner::setAnalytic(int i, double stat, double mean, double sd, LisaOutput& out) const
+    {
+        double z = sd > 0 ? (stat - mean) / sd : 0;
+        return this->setPValue(i, 0.5 * std::erfc(std::fabs(z) / std::sqrt(2.0)), out);
+    }
+
+    bool LisaRunner::setPValue(int i, double p, LisaOutput& out) const
+    {
+        out.sig_local[i] = p;
+        out.sig_cats[i] = sig_category(p);
+        return p <= params.significance_cutoff;
+    }
+
+    template <class Stat, class Rows, class Values>
+    void LisaRunner::runRange(const Stat& stat, const Rows& rows, const Values& values, size_t start, size_t end,
+                              LisaOutput& out)
+    {
+        int num_labels = (int)out.labels.size();
+        int undefined_cluster = num_labels - 2, isolated_cluster = num_labels - 1;
+        int permutations = params.permutations;
+        int range = (int)pool.size() - 1;
+        int stop_tail = this->stopTail();
+        bool analytic = params.permutation_method == "analytic";
+
+        Shuffler shuffler(table ? 0 : range);
+        NbrRow row;
+        std::vector<int> sample;
+        std::vector<std::pair<int, double> > sort_buf;
+        for (size_t ii = start; ii < end; ++ii) {
+            int i = (int)ii;
+            if (undefs[i]) {
+                this->setCluster(i, undefined_cluster, true, out);
+                continue;
+            }
+            this->loadRow(i, rows, values, Stat::BINARY, Stat::ROW_STANDARDIZED, stat.WithSelf(), row, sort_buf);
+            int nn = (int)row.nbrs.size();
+            out.nn[i] = nn;
+            if (nn == 0) {
+                this->setCluster(i, isolated_cluster, true, out);
+                continue;
+            }
+
+            double lag = 0;
+            double observed = stat.Observed(i, row, lag);
+            out.lisa_vals[i] = observed;
+            out.lags[i] = lag;
+
+            double mean, sd;
+            if (analytic && stat.Analytic(i, row, mean, sd)) {
+                bool significant = this->setAnalytic(i, observed, mean, sd, out);
+                this->setCluster(i, stat.Cluster(i, observed, lag, 0, 0), significant, out);
+                continue;
+            }
+
+            // number of permutations >= the observed statistic, out of used
+            // (none if p is 1 anyway)
+            int count = 0, used = 0;
+            if (!kept_used.empty() && kept_used[i] >= 0) {
+                count = kept_counts[i];
+                used = kept_used[i];
+            } else if (nn <= range && stat.NeedsPermutation(i, observed)) {
+                while (used < permutations) {
+                    this->drawSample(i, used, nn, shuffler, sample);
+                    if (stat.Permuted(i, &sample[0], row) >= observed) ++count;
+                    ++used;
+                    int tail = Stat::TWO_SIDED ? std::min(count, used - count) : count;
+                    if (tail >= stop_tail) break;
+                }
+            }
+            out.perm_counts[i] = count;
+            out.perms_used[i] = used;
+            bool significant = this->setSignificance(i, count, used, Stat::TWO_SIDED, out);
+            this->setCluster(i, stat.Cluster(i, observed, lag, count, used), significant, out);
+        }
+    }
+
+    void LisaRunner::batchLag(const std::vector<double>& z, int m, const int* nbrs, const NbrRow& row,
+                              std::vector<double>& lanes, std::vector<double>& lag) const
+    {
+        std::fill(lanes.begin(), lanes.end(), 0.0);
+        for (size_t k = 0; k < row.nbrs.size(); ++k) {
+            double wk = row.wts[k];
+            const double* zj = &z[(size_t)nbrs[k] * m];
+            double* lane = &lanes[(k & 3) * m];
+            for (int v = 0; v < m; ++v) lane[v] += wk * zj[v];
+        }
+        const double *l0 = &lanes[0], *l1 = &lanes[m], *l2 = &lanes[2 * m], *l3 = &lanes[3 * m];
+        for (int v = 0; v < m; ++v) lag[v] = (l0[v] + l2[v]) + (l1[v] + l3[v]);
+    }
+
+    template <class Rows, class Values>
+    void LisaRunner::runMoranBatchRange(const std::vector<double>& z, int m, const Rows& rows, const Values& values,
+                                        size_t start, size_t end, std::vector<LisaOutput>& outs)
+    {
+        int undefined_cluster = 5, isolated_cluster = 6;
+        int permutations = params.permutations;
+        int range = (int)pool.size() - 1;
+        int stop_tail = this->stopTail();
+
+        Shuffler shuffler(table ? 0 : range);
+        NbrRow row;
+        std::vector<int> sample;
+        std::vector<std::pair<int, double> > sort_buf;
+        std::vector<double> lag(m), perm_lag(m), observed(m), lanes(4 * (size_t)m);
+        std::vector<int> count(m), used(m);
+        std::vector<unsigned char> stopped(m);
+        for (size_t ii = start; ii < end; ++ii) {
+            int i = (int)ii;
+            if (undefs[i]) {
+                for (int v = 0; v < m; ++v) this->setCluster(i, undefined_cluster, true, outs[v]);
+                continue;
+            }
+            this->loadRow(i, rows, values, false, true, false, row, sort_buf);
+            int nn = (int)row.nbrs.size();
+            for (int v = 0; v < m; ++v) outs[v].nn[i] = nn;
+            if (nn == 0) {
+                for (int v = 0; v < m; ++v) this->setCluster(i, isolated_cluster, true, outs[v]);
+                continue;
+            }
+
+            // the variables of an observation are contiguous: the inner loops
+            // run over the variables
+            const double* zi = &z[(size_t)i * m];
+            this->batchLag(z, m, row.nbrs.data(), row, lanes, lag);
+            for (int v = 0; v < m; ++v) {
+                observed[v] = zi[v] * lag[v];
+                outs[v].lisa_vals[i] = observed[v];
+                outs[v].lags[i] = lag[v];
+            }
+
+            std::fill(count.begin(), count.end(), 0);
+            std::fill(used.begin(), used.end(), 0);
+            // a stopped variable keeps its count, as if run alone; the
+            // permutations go on while any variable is still running
+            std::fill(stopped.begin(), stopped.end(), 0);
+            int running = nn <= range ? m : 0;
+            for (int perm = 0; running > 0 && perm < permutations; ++perm) {
+                this->drawSample(i, perm, nn, shuffler, sample);
+                this->batchLag(z, m, &sample[0], row, lanes, perm_lag);
+                for (int v = 0; v < m; ++v) {
+                    if (stopped[v]) continue;
+                    count[v] += zi[v] * perm_lag[v] >= observed[v];
+                    used[v] = perm + 1;
+                    if (std::min(count[v], used[v] - count[v]) >= stop_tail) {
+                        stopped[v] = 1;
+                        --running;
+                    }
+                }
+            }
+            for (int v = 0; v < m; ++v) {
+                outs[v].perm_counts[i] = count[v];
+                outs[v].perms_used[i] = used[v];
+                bool significant = this->setSignificance(i, count[v], used[v], true, outs[v]);
+                this->setCluster(i, MoranStat::Quadrant(zi[v], lag[v]), significant, outs[v]);
+            }
+        }
+    }
+
+    void LisaRunner::loadTable()
+    {
+        table.reset();
+        if (params.permutation_method == "lookup" && params.permutations > 0) {
+            int max_nn = 0;
+            for (int i = 0; i < num_obs; ++i) max_nn = std::max(max_nn, (int)w.GetNbrSize(i));
+            int range = (int)pool.size() - 1;
+            table = GetPermutationTable(range, std::min(max_nn, std::max(range, 0)), params.permutations,
+                                        params.last_seed_used, params.n_threads);
+        }
+    }
+
+    LisaOutput LisaRunner::makeOutput(const char** labels, const char** colors, int num_labels) const
+    {
+        LisaOutput out;
+        out.labels.assign(labels, labels + num_labels);
+        out.colors.assign(colors, colors + num_labels);
+        out.lisa_vals.resize(num_obs, 0);
+        out.lags.resize(num_obs, 0);
+        out.sig_local.resize(num_obs, 1.0);
+        out.sig_cats.resize(num_obs, 0);
+        out.clusters.resize(num_obs, 0);
+        out.nn.resize(num_obs, 0);
+        out.sig_clusters.resize(num_obs, 0);
+        out.perm_counts.resize(num_obs, 0);
+        out.perms_used.resize(num_obs, 0);
+        return out;
+    }
+
+    void LisaRunner::toFileOrder(LisaOutput& out) const
+    {
+        const SpatialOrder& so = w.GetSpatialOrder();
+        out.lisa_vals = FromSpatialOrder(out.lisa_vals, so);
+        out.lags = FromSpatialOrder(out.lags, so);
+        out.sig_local = FromSpatialOrder(out.sig_local, so);
+        out.sig_cats = FromSpatialOrder(out.sig_cats, so);
+        out.clusters = FromSpatialOrder(out.clusters, so);
+        out.nn = FromSpatialOrder(out.nn, so);
+        out.sig_clusters = FromSpatialOrder(out.sig_clusters, so);
+        out.perm_counts = FromSpatialOrder(out.perm_counts, so);
+        out.perms_used = FromSpatialOrder(out.perms_used, so);
+    }
+
+    template <class Stat>
+    LisaOutput LisaRunner::Run(const Stat& stat, const char** labels, const char** colors, int num_labels)
+    {
+        LisaOutput out = this->makeOutput(labels, colors, num_labels);
+        this->loadTable();
+        w.VisitRows(true, false, [&](auto rows, auto values) {
+            gda_parallel_for(num_obs, params.n_threads, [&](size_t start, size_t end, int) {
+                this->runRange(stat, rows, values, start, end, out);
+            });
+        });
+        this->toFileOrder(out);
+        return out;
+    }
+
+    std::vector<unsigned char> LisaRunner::RowsWithNeighborIn(const std::vector<unsigned char>& marked)
+    {
+        std::vector<unsigned char> result(num_obs, 0);
+        w.VisitRows(false, false, [&](auto rows, auto) {
+            gda_parallel_for(num_obs, params.n_threads, [&](size_t start, size_t end, int) {
+                for (size_t i = start; i < end; ++i) {
+                    for (auto c = rows.Row(i); c.Next();) {
+                        int j = (int)c.Nbr();
+                        if (marked[j] && !undefs[j]) {
+                            result[i] = 1;
+                            break;
+                        }
+                    }
+                }
+            });
+        });
+        return result;
+    }
+
+    void LisaRunner::KeepCounts(const LisaOutput& prev, const std::vector<unsigned char>& rerun)
+    {
+        kept_counts.assign(num_obs, 0);
+        kept_used.assign(num_obs, -1);
+        for (int i = 0; i < num_obs; ++i) {
+            if (rerun[i]) continue;
+            kept_counts[i] = prev.perm_counts[file_ids[i]];
+            kept_used[i] = prev.perms_used[file_ids[i]];
+        }
+    }
+
+    std::vector<LisaOutput> LisaRunner::RunMoranBatch(const std::vector<double>& z, int m)
+    {
+        std::vector<LisaOutput> outs(m, this->makeOutput(MORAN_LABELS, MORAN_COLORS, 7));
+        this->loadTable();
+        w.VisitRows(true, false, [&](auto rows, auto values) {
+            gda_parallel_for(num_obs, params.n_threads, [&](size_t start, size_t end, int) {
+                this->runMoranBatchRange(z, m, rows, values, start, end, outs);
+            });
+        });
+        for (int v = 0; v < m; ++v) this->toFileOrder(outs[v]);
+        return outs;
+    }
+}
+
+namespace {
+    // the tables of the last lookup runs, most recently used first
+    std::list<std::shared_ptr<const PermutationTable> > permutation_tables;
+    const size_t MAX_PERMUTATION_TABLES = 8;
+}
+
+std::shared_ptr<const PermutationTable> GetPermutationTable(int range, int width, int permutations, uint64_t seed,
+                                                            int n_threads)
+{
+    std::list<std::shared_ptr<const PermutationTable> >::iterator it;
+    for (it = permutation_tables.begin(); it != permutation_tables.end(); ++it) {
+        const PermutationTable& t = **it;
+        // the first draws of a row do not depend on the width, so a wider
+        // table serves narrower rows
+        if (t.range == range && t.width >= width && t.permutations == permutations && t.seed == seed) {
+            permutation_tables.splice(permutation_tables.begin(), permutation_tables, it);
+            return permutation_tables.front();
+        }
+    }
+
+    std::shared_ptr<PermutationTable> table = std::make_shared<PermutationTable>();
+    table->range = range;
+    table->width = width;
+    table->permutations = permutations;
+    table->seed = seed;
+    table->positions.assign((size_t)permutations * width, 0);
+    Philox4x32 philox(seed);
+    gda_parallel_for(permutations, n_threads, [&](size_t start, size_t end, int) {
+        Shuffler shuffler(range);
+        for (size_t perm = start; perm < end; ++perm) {
+            PhiloxStream rng(philox, (uint32_t)perm, 0, LOOKUP_STREAM);
+            shuffler.Draw(rng, width, &table->positions[perm * width]);
+        }
+    });
+
+    permutation_tables.push_front(table);
+    if (permutation_tables.size() > MAX_PERMUTATION_TABLES) permutation_tables.pop_back();
+    return table;
+}
+
+void ClearPermutationTables()
+{
+    permutation_tables.clear();
+}
+
+LisaOutput LocalMoran(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs,
+                      const LisaParams& params)
+{
+    LisaRunner runner(w, undefs, params);
+    std::vector<double> z = runner.Standardize(runner.ToInternal(data));
+    MoranStat stat;
+    stat.z = z.data();
+    stat.moments = runner.GetMoments(z);
+    return runner.Run(stat, MORAN_LABELS, MORAN_COLORS, 7);
+}
+
+std::vector<LisaOutput> LocalMoranBatch(LagWeights& w, const std::vector<std::vector<double> >& data,
+                                        const std::vector<std::vector<bool> >& undefs, const LisaParams& params)
+{
+    if (params.permutation_method == "analytic") {
+        // no permutations to share
+        std::vector<LisaOutput> results(data.size());
+        for (size_t v = 0; v < data.size(); ++v) {
+            results[v] = LocalMoran(w, data[v], v < undefs.size() ? undefs[v] : std::vector<bool>(), params);
+        }
+        return results;
+    }
+
+    // the variables with the same undefined observations share the pool of
+    // random neighbors, and run together
+    size_t num_obs = w.GetNumObs();
+    std::map<std::vector<bool>, std::vector<size_t> > groups;
+    for (size_t v = 0; v < data.size(); ++v) {
+        std::vector<bool> undefs_v(num_obs, false);
+        if (v < undefs.size()) {
+            for (size_t i = 0; i < undefs[v].size() && i < num_obs; ++i) undefs_v[i] = undefs[v][i];
+        }
+        groups[undefs_v].push_back(v);
+    }
+
+    std::vector<LisaOutput> results(data.size());
+    std::map<std::vector<bool>, std::vector<size_t> >::iterator it;
+    for (it = groups.begin(); it != groups.end(); ++it) {
+        const std::vector<size_t>& vars = it->second;
+        int m = (int)vars.size();
+        LisaRunner runner(w, it->first, params);
+        std::vector<double> z(num_obs * m);
+        for (int v = 0; v < m; ++v) {
+            std::vector<double> z_v = runner.Standardize(runner.ToInternal(data[vars[v]]));
+            for (size_t i = 0; i < num_obs; ++i) z[i * m + v] = z_v[i];
+        }
+        std::vector<LisaOutput> outs = runner.RunMoranBatch(z, m);
+        for (int v = 0; v < m; ++v) std::swap(results[vars[v]], outs[v]);
+    }
+    return results;
+}
+
+LocalMoranSession::LocalMoranSession(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs,
+                                     const LisaParams& params, double max_stale)
+: data(data), undefs(undefs), params(params), max_stale(max_stale), num_stale(0)
+{
+    this->data.resize(w.GetNumObs(), 0);
+    this->undefs.resize(w.GetNumObs(), false);
+    this->run(w, std::vector<int>());
+}
+
+const LisaOutput& LocalMoranSession::Update(LagWeights& w, const std::vector<int>& indices,
+                                            const std::vector<double>& values)
+{
+    std::vector<int> edited;
+    for (size_t k = 0; k < indices.size() && k < values.size(); ++k) {
+        int f = indices[k];
+        if (f < 0 || f >= (int)data.size() || data[f] == values[k]) continue;
+        data[f] = values[k];
+        if (!undefs[f]) edited.push_back(f);
+    }
+    num_stale += (int)edited.size();
+    this->run(w, edited);
+    return output;
+}
+
+void LocalMoranSession::run(LagWeights& w, const std::vector<int>& edited)
+{
+    LisaRunner runner(w, undefs, params);
+    std::vector<double> z = runner.Standardize(runner.ToInternal(data));
+    int num_obs = (int)z.size();
+    // by file id: the spatial order of w may change between updates
+    const SpatialOrder& so = w.GetSpatialOrder();
+    std::vector<signed char> signs(num_obs);
+    for (int i = 0; i < num_obs; ++i) signs[so.IsEmpty() ? i : so.order[i]] = (z[i] > 0) - (z[i] < 0);
+
+    // with row-standardized weights, a permutation of i is >= the observed
+    // statistic iff sign(z_i) (lag of the sample - lag of i) >= 0 in the
+    // data itself: the count of i only changes with x_i, its lag or the
+    // sign of z_i. The permutations that drew an edited value are not
+    // evaluated again, until there are more than max_stale of them
+    int pool_size = runner.GetPoolSize();
+    bool rerun_all = output.perm_counts.empty() || num_stale > max_stale * pool_size ||
+                     signs.size() != z_signs.size();
+    bool is_analytic = params.permutation_method == "analytic";
+    permuted.clear();
+    if (rerun_all) {
+        num_stale = 0;
+        for (int f = 0; f < num_obs && !is_analytic; ++f) {
+            if (!undefs[f]) permuted.push_back(f);
+        }
+    } else {
+        std::vector<unsigned char> marked(num_obs, 0);
+        for (size_t k = 0; k < edited.size(); ++k) {
+            marked[so.IsEmpty() ? edited[k] : so.rank[edited[k]]] = 1;
+        }
+        std::vector<unsigned char> rerun = runner.RowsWithNeighborIn(marked);
+        for (int i = 0; i < num_obs; ++i) {
+            int f = so.IsEmpty() ? i : so.order[i];
+            rerun[i] |= marked[i] || signs[f] != z_signs[f];
+            if (rerun[i] && !undefs[f] && !is_analytic) permuted.push_back(f);
+        }
+        std::sort(permuted.begin(), permuted.end());
+        runner.KeepCounts(output, rerun);
+    }
+    z_signs.swap(signs);
+
+    MoranStat stat;
+    stat.z = z.data();
+    stat.moments = runner.GetMoments(z);
+    output = runner.Run(stat, MORAN_LABELS, MORAN_COLORS, 7);
+}
+
+LisaOutput LocalG(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs, bool is_gstar,
+                  const LisaParams& params)
+{
+    LisaRunner runner(w, undefs, params);
+    std::vector<double> x = runner.ToInternal(data);
+    GStat stat;
+    stat.x = x.data();
+    stat.denom = runner.SumDefined(x);
+    int m = runner.GetPoolSize();
+    stat.expected = is_gstar ? (m > 0 ? 1.0 / m : 0) : (m > 1 ? 1.0 / (m - 1) : 0);
+    stat.is_gstar = is_gstar;
+    stat.moments = runner.GetMoments(x);
+    return runner.Run(stat, G_LABELS, G_COLORS, 5);
+}
+
+LisaOutput LocalGeary(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs,
+                      const LisaParams& params)
+{
+    LisaRunner runner(w, undefs, params);
+    std::vector<double> z = runner.Standardize(runner.ToInternal(data));
+    GearyStat stat;
+    stat.z = z.data();
+    return runner.Run(stat, GEARY_LABELS, GEARY_COLORS, 7);
+}
+
+LisaOutput LocalMultiGeary(LagWeights& w, const std::vector<std::vector<double> >& data,
+                           const std::vector<std::vector<bool> >& undefs, const LisaParams& params)
+{
+    std::vector<bool> any_undefs(w.GetNumObs(), false);
+    for (size_t v = 0; v < undefs.size(); ++v) {
+        for (size_t i = 0; i < undefs[v].size() && i < any_undefs.size(); ++i) {
+            if (undefs[v][i]) any_undefs[i] = true;
+        }
+    }
+    LisaRunner runner(w, any_undefs, params);
+
+    std::vector<std::vector<double> > z(data.size());
+    MultiGearyStat stat;
+    for (size_t v = 0; v < data.size(); ++v) {
+        z[v] = runner.Standardize(runner.ToInternal(data[v]));
+        stat.z.push_back(z[v].data());
+    }
+    return runner.Run(stat, MULTI_GEARY_LABELS, MULTI_GEARY_COLORS, 5);
+}
+
+BitMask PackMask(const std::vector<double>& data)
+{
+    BitMask mask((data.size() + 31) / 32, 0);
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (data[i] != 0) mask[i >> 5] |= 1U << (i & 31);
+    }
+    return mask;
+}
+
+BitMask PackMask(const std::vector<bool>& flags)
+{
+    BitMask mask((flags.size() + 31) / 32, 0);
+    for (size_t i = 0; i < flags.size(); ++i) {
+        if (flags[i]) mask[i >> 5] |= 1U << (i & 31);
+    }
+    return mask;
+}
+
+LisaOutput LocalJoinCount(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs,
+                          const LisaParams& params)
+{
+    return LocalJoinCount(w, PackMask(data), PackMask(undefs), params);
+}
+
+LisaOutput LocalJoinCount(LagWeights& w, const BitMask& x, const BitMask& undef_mask, const LisaParams& params)
+{
+    size_t num_obs = w.GetNumObs();
+    std::vector<bool> undefs(num_obs, false);
+    for (size_t i = 0; i < num_obs && (i >> 5) < undef_mask.size(); ++i) {
+        undefs[i] = (undef_mask[i >> 5] >> (i & 31)) & 1;
+    }
+    LisaRunner runner(w, undefs, params);
+    std::vector<uint64_t> bits = runner.ToInternalBits(x);
+    JoinCountStat stat;
+    stat.bits = bits.data();
+    stat.nbr_bits = bits.data();
+    return runner.Run(stat, JOINCOUNT_LABELS, JOINCOUNT_COLORS, 4);
+}
+
+LisaOutput LocalBivariateJoinCount(LagWeights& w, const BitMask& x, const BitMask& y, const BitMask& undef_mask,
+                                   const LisaParams& params)
+{
+    size_t num_obs = w.GetNumObs();
+    std::vector<bool> undefs(num_obs, false);
+    for (size_t i = 0; i < num_obs && (i >> 5) < undef_mask.size(); ++i) {
+        undefs[i] = (undef_mask[i >> 5] >> (i & 31)) & 1;
+    }
+    LisaRunner runner(w, undefs, params);
+    std::vector<uint64_t> x_bits = runner.ToInternalBits(x), y_bits = runner.ToInternalBits(y);
+    JoinCountStat stat;
+    stat.bits = x_bits.data();
+    stat.nbr_bits = y_bits.data();
+    return runner.Run(stat, JOINCOUNT_LABELS, JOINCOUNT_COLORS, 4);
+}
+
+LisaOutput LocalMultiJoinCount(LagWeights& w, const std::vector<BitMask>& masks,
+                               const std::vector<BitMask>& undef_masks, const LisaParams& params)
+{
+    // 32 observations per AND / OR; a short mask is 0 (and defined) past its end
+    size_t num_words = (w.GetNumObs() + 31) / 32;
+    BitMask colocation(num_words, masks.empty() ? 0 : ~0U), undefs(num_words, 0);
+    for (size_t v = 0; v < masks.size(); ++v) {
+        for (size_t k = 0; k < num_words; ++k) {
+            colocation[k] &= k < masks[v].size() ? masks[v][k] : 0;
+        }
+    }
+    for (size_t v = 0; v < undef_masks.size(); ++v) {
+        for (size_t k = 0; k < num_words && k < undef_masks[v].size(); ++k) undefs[k] |= undef_masks[v][k];
+    }
+
+    // two variables that never co-occur (as in libgeoda): the bivariate join
+    // count of the first with the second
+    if (masks.size() == 2) {
+        bool co_occur = false;
+        for (size_t k = 0; k < num_words && !co_occur; ++k) {
+            uint32_t valid = ~undefs[k];
+            size_t rest = w.GetNumObs() - k * 32;
+            if (rest < 32) valid &= (1U << rest) - 1;
+            co_occur = (colocation[k] & valid) != 0;
+        }
+        if (!co_occur) return LocalBivariateJoinCount(w, masks[0], masks[1], undefs, params);
+    }
+    return LocalJoinCount(w, colocation, undefs, params);
+}
+
+void Recategorize(LisaOutput& lisa, double significance_cutoff, const std::string& correction)
+{
+    size_t num_obs = lisa.sig_local.size();
+    int num_labels = (int)lisa.labels.size();
+    int undefined_cluster = num_labels - 2, isolated_cluster = num_labels - 1;
+
+    // the p-values of the tested observations
+    std::vector<double> pvals;
+    for (size_t i = 0; i < num_obs; ++i) {
+        int c = lisa.sig_clusters[i];
+        if (c != undefined_cluster && c != isolated_cluster) pvals.push_back(lisa.sig_local[i]);
+    }
+    double cutoff = significance_cutoff;
+    if (correction == "bonferroni") {
+        cutoff = pvals.empty() ? 0 : significance_cutoff / pvals.size();
+    } else if (correction == "fdr") {
+        // Benjamini-Hochberg: the largest p_(k) <= k * cutoff / n
+        std::sort(pvals.begin(), pvals.end());
+        cutoff = 0;
+        for (size_t k = 0; k < pvals.size(); ++k) {
+            if (pvals[k] <= (k + 1) * significance_cutoff / pvals.size()) cutoff = pvals[k];
+        }
+    }
+
+    for (size_t i = 0; i < num_obs; ++i) {
+        int c = lisa.sig_clusters[i];
+        bool tested = c != undefined_cluster && c != isolated_cluster;
+        lisa.sig_cats[i] = tested ? sig_category(lisa.sig_local[i]) : 0;
+        lisa.clusters[i] = !tested || lisa.sig_local[i] <= cutoff ? c : 0;
+    }
+}
+
+std::vector<double> RateStandardizeEB(const std::vector<double>& events, const std::vector<double>& base,
+                                      std::vector<bool>& undefs)
+{
+    size_t num_obs = std::min(events.size(), base.size());
+    undefs.resize(num_obs, false);
+    std::vector<double> rates(num_obs, 0), z(num_obs, 0);
+    double sum_e = 0, sum_b = 0;
+    int num_valid = 0;
+    for (size_t i = 0; i < num_obs; ++i) {
+        if (undefs[i]) continue;
+        if (base[i] <= 0) {
+            undefs[i] = true;
+            continue;
+        }
+        sum_e += events[i];
+        sum_b += base[i];
+        rates[i] = events[i] / base[i];
+        ++num_valid;
+    }
+    if (num_valid == 0 || sum_b == 0) {
+        return z;
+    }
+    double b_hat = sum_e / sum_b;
+    double ssum = 0;
+    for (size_t i = 0; i < num_obs; ++i) {
+        if (!undefs[i]) ssum += base[i] * (rates[i] - b_hat) * (rates[i] - b_hat);
+    }
+    double a_hat = ssum / sum_b - b_hat / (sum_b / num_valid);
+    for (size_t i = 0; i < num_obs; ++i) {
+        if (undefs[i]) continue;
+        double var = a_hat + b_hat / base[i];
+        if (var > 0) {
+            z[i] = (rates[i] - b_hat) / std::sqrt(var);
+        } else {
+            undefs[i] = true;
+        }
+    }
+    return z;
+}
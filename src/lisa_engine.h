@@ -0,0 +1,237 @@
+#ifndef JSGEODA_LISA_ENGINE_H
+#define JSGEODA_LISA_ENGINE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class LagWeights;
+
+/**
+ * Options of the conditional permutation test of the local statistics
+ */
+struct LisaParams {
+    double significance_cutoff;
+    int permutations;
+    // "complete": new random neighbors are drawn for every observation and
+    // permutation; "lookup": every observation takes its random neighbors from
+    // the same table of permutations; "analytic" (local Moran, G and G*): no
+    // permutations, p from the normal approximation with the mean and
+    // variance under conditional randomization (the other statistics use
+    // "complete"). With few neighbors the statistic is not normal, so the
+    // approximation is rough, and poor for skewed variables: a pseudo p-value
+    // of 0.001 can come out near 0.05
+    std::string permutation_method;
+    uint64_t last_seed_used;
+    int n_threads;
+    // stop the permutations of an observation as soon as it cannot be
+    // significant at significance_cutoff
+    bool early_stopping;
+
+    LisaParams()
+    : significance_cutoff(0.05), permutations(999), permutation_method("complete"), last_seed_used(123456789),
+      n_threads(1), early_stopping(false) {}
+};
+
+/**
+ * The results of a local statistic, in file order (see LisaResult)
+ */
+struct LisaOutput {
+    std::vector<double> lisa_vals;
+    std::vector<double> lags;
+    std::vector<double> sig_local;  // pseudo p-values
+    std::vector<int> sig_cats;      // 4..1 for p <= 0.0001, 0.001, 0.01, 0.05
+    std::vector<int> clusters;      // 0 if not significant
+    std::vector<int> sig_clusters;  // the cluster if significant (see Recategorize)
+    std::vector<int> nn;            // number of neighbors, without undefined ones
+    std::vector<int> perm_counts;   // permutations >= the statistic
+    std::vector<int> perms_used;    // permutations drawn (fewer with early stopping)
+    std::vector<std::string> labels;
+    std::vector<std::string> colors;
+};
+
+/**
+ * Local spatial autocorrelation statistics, with pseudo p-values from
+ * conditional permutations: the value of observation i is held fixed, and
+ * its neighbors are replaced by random observations (the same number of
+ * them, never i itself, never an undefined observation).
+ *
+ * The observations are split over params.n_threads threads. The random
+ * neighbors come from a counter-based generator (see philox.h): the draw of
+ * permutation k of an observation only depends on last_seed_used, k and the
+ * position of the observation in the file (only on k with "lookup"), so the
+ * results are the same for any number of threads and any spatial order of the
+ * weights (compact weights can differ by the float rounding of the weights).
+ *
+ * The statistics, lags and neighbor counts are the ones of libgeoda (GeoDa),
+ * but its random generator is not: the same last_seed_used does not give the
+ * pseudo p-values and clusters of libgeoda or of earlier jsgeoda versions,
+ * only values within the Monte Carlo error of them.
+ *
+ * With early_stopping, the permutations of an observation stop once the
+ * smaller tail is large enough for p > significance_cutoff whatever the
+ * remaining permutations give (a curtailed, Besag-Clifford sequential test).
+ * The significant observations still run all the permutations, so the
+ * clusters are the same as without it; the p-value of a stopped observation
+ * is (tail + 1) / (used + 1).
+ *
+ * The weights are row-standardized over the defined neighbors, and the
+ * diagonal (e.g. of kernel weights) is skipped, except by G*. Undefined
+ * observations are left out of the statistics, and observations without
+ * neighbors are "Isolated".
+ */
+
+// local Moran: z_i * sum_j w_ij z_j of the standardized data
+LisaOutput LocalMoran(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs,
+                      const LisaParams& params);
+
+// local Moran of several variables over the same weights. The variables
+// with the same undefined observations run in one pass: every random sample
+// of neighbors is drawn once and evaluated on all of them. The results are
+// the same as LocalMoran of each variable
+std::vector<LisaOutput> LocalMoranBatch(LagWeights& w, const std::vector<std::vector<double> >& data,
+                                        const std::vector<std::vector<bool> >& undefs, const LisaParams& params);
+
+/**
+ * LocalMoranSession
+ *
+ * Local Moran of data that is edited a few values at a time (e.g. what-if
+ * scenarios). Update() runs the permutations again only for the observations
+ * whose count can change: the edited ones, their neighbors (their lag
+ * changed) and those whose z-score changed sign with the new mean. The other
+ * observations keep their counts, and the statistics, lags, p-values and
+ * clusters of all of them are set from the new data.
+ *
+ * The kept counts ignore that the edited values are part of the random
+ * neighbors of others (nn * edited / n of their permutations on average).
+ * Once the edits since the last full run are more than max_stale of the
+ * defined observations, every observation runs again. The permuted ones get
+ * the same results as LocalMoran of the edited data; the others may not: a
+ * kept count is off by the permutations that drew an edited value, so its
+ * p-value, and with it the significance and the cluster, can differ from a
+ * fresh LocalMoran (by 0.02 in p after two edits on 85 observations). With
+ * the default max_stale, any edit runs everything again on maps of fewer
+ * than 1000 observations; max_stale 0 always gives the results of LocalMoran.
+ */
+class LocalMoranSession {
+public:
+    LocalMoranSession(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs,
+                      const LisaParams& params, double max_stale = 0.001);
+
+    // set data[indices[k]] = values[k] (file order) and update the results;
+    // w: the weights the session was created with
+    const LisaOutput& Update(LagWeights& w, const std::vector<int>& indices, const std::vector<double>& values);
+
+    const LisaOutput& GetOutput() const { return output; }
+
+    const std::vector<double>& GetData() const { return data; }
+
+    // the observations permuted by the last update (file ids, ascending)
+    const std::vector<int>& GetPermuted() const { return permuted; }
+
+    int GetNumPermuted() const { return (int)permuted.size(); }
+
+protected:
+    std::vector<double> data;
+    std::vector<bool> undefs;
+    LisaParams params;
+    double max_stale;
+    int num_stale;  // edited values since the last full run
+    std::vector<int> permuted;
+    std::vector<signed char> z_signs;  // by file id
+    LisaOutput output;
+
+    void run(LagWeights& w, const std::vector<int>& edited);
+};
+
+// local G: sum_j w_ij x_j / sum_{j != i} x_j; local G* (is_gstar): the sums
+// include i itself, with weight 1 unless the weights have a diagonal
+LisaOutput LocalG(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs, bool is_gstar,
+                  const LisaParams& params);
+
+// local Geary: sum_j w_ij (z_i - z_j)^2 of the standardized data
+LisaOutput LocalGeary(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs,
+                      const LisaParams& params);
+
+// multivariate local Geary: the local Geary averaged over the variables. An
+// observation is undefined if any of its variables is
+LisaOutput LocalMultiGeary(LagWeights& w, const std::vector<std::vector<double> >& data,
+                           const std::vector<std::vector<bool> >& undefs, const LisaParams& params);
+
+/**
+ * 0/1 indicators packed 32 to a word: x_i is bit i % 32 of word i / 32 (as
+ * the bits of a JS Uint32Array)
+ */
+typedef std::vector<uint32_t> BitMask;
+
+// bit i is data[i] != 0
+BitMask PackMask(const std::vector<double>& data);
+
+BitMask PackMask(const std::vector<bool>& flags);
+
+// local join count of 0/1 data (any value other than 0 is 1): for x_i = 1,
+// the number of neighbors with x_j = 1, tested one-sided. The data is packed
+// into bits (see the BitMask version)
+LisaOutput LocalJoinCount(LagWeights& w, const std::vector<double>& data, const std::vector<bool>& undefs,
+                          const LisaParams& params);
+
+// local join count of a packed mask, undefined where undef_mask is 1 (may be
+// empty). The permutations read the random neighbors from the bits
+LisaOutput LocalJoinCount(LagWeights& w, const BitMask& x, const BitMask& undef_mask, const LisaParams& params);
+
+// bivariate join count: for x_i = 1, the number of neighbors with y_j = 1
+// (for x and y that never co-occur), tested one-sided
+LisaOutput LocalBivariateJoinCount(LagWeights& w, const BitMask& x, const BitMask& y, const BitMask& undef_mask,
+                                   const LisaParams& params);
+
+// co-location join count: x_i = 1 where all the masks are 1 (a word-wise
+// AND), undefined where any of the undef_masks is 1. Two masks that are
+// never both 1 get the bivariate join count of the first with the second
+LisaOutput LocalMultiJoinCount(LagWeights& w, const std::vector<BitMask>& masks,
+                               const std::vector<BitMask>& undef_masks, const LisaParams& params);
+
+/**
+ * Set the clusters of lisa again for another significance cutoff, from the
+ * p-values and the clusters kept in the result; no permutations run.
+ * correction: "bonferroni" (cutoff / number of tested observations), "fdr"
+ * (Benjamini-Hochberg false discovery rate), or anything else for none.
+ */
+void Recategorize(LisaOutput& lisa, double significance_cutoff, const std::string& correction);
+
+/**
+ * PermutationTable
+ *
+ * The random neighbors of the "lookup" method: row k holds the first width
+ * positions of a random permutation of [0, range), where range is the number
+ * of defined observations minus 1 (observation i itself is left out by
+ * skipping its position).
+ */
+struct PermutationTable {
+    int range;
+    int width;
+    int permutations;
+    uint64_t seed;
+    std::vector<int32_t> positions; // permutations * width
+};
+
+/**
+ * The permutation table of (range, permutations, seed) with rows of at least
+ * width positions. The tables are kept after a LISA call (the last 8 of them),
+ * so the runs of many variables over the same weights, and the runs with
+ * another significance cutoff, build the table once.
+ */
+std::shared_ptr<const PermutationTable> GetPermutationTable(int range, int width, int permutations, uint64_t seed,
+                                                            int n_threads);
+
+// free the kept permutation tables
+void ClearPermutationTables();
+
+/**
+ * Empirical Bayes standardized rates of events / base (Assuncao-Reis). The
+ * observations with base 0 become undefined.
+ */
+std::vector<double> RateStandardizeEB(const std::vector<double>& events, const std::vector<double>& base,
+                                      std::vector<bool>& undefs);
+
+#endif //JSGEODA_LISA_ENGINE_H
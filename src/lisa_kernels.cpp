@@ -0,0 +1,187 @@
+#include "lisa_kernels.h"
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define JSGEODA_LISA_SIMD128 1
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define JSGEODA_LISA_AVX2 1
+#endif
+
+namespace {
+    typedef double (*GatherDotFunc)(const double*, const int*, const double*, int);
+    typedef double (*GatherSqDiffFunc)(const double*, const int*, const double*, int, double);
+
+    inline double add_lanes(const double* l) { return (l[0] + l[2]) + (l[1] + l[3]); }
+
+    double gather_dot_scalar(const double* x, const int* idx, const double* w, int nn)
+    {
+        double l[4] = {0, 0, 0, 0};
+        for (int k = 0; k < nn; ++k) l[k & 3] += w[k] * x[idx[k]];
+        return add_lanes(l);
+    }
+
+    double gather_sq_diff_scalar(const double* x, const int* idx, const double* w, int nn, double xi)
+    {
+        double l[4] = {0, 0, 0, 0};
+        for (int k = 0; k < nn; ++k) {
+            double d = xi - x[idx[k]];
+            l[k & 3] += w[k] * (d * d);
+        }
+        return add_lanes(l);
+    }
+
+#ifdef JSGEODA_LISA_AVX2
+    __attribute__((target("avx2")))
+    double gather_dot_avx2(const double* x, const int* idx, const double* w, int nn)
+    {
+        __m256d acc = _mm256_setzero_pd();
+        int k = 0;
+        for (; k + 4 <= nn; k += 4) {
+            __m256d xv = _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i*)(idx + k)), 8);
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(w + k), xv));
+        }
+        double l[4];
+        _mm256_storeu_pd(l, acc);
+        for (; k < nn; ++k) l[k & 3] += w[k] * x[idx[k]];
+        return add_lanes(l);
+    }
+
+    __attribute__((target("avx2")))
+    double gather_sq_diff_avx2(const double* x, const int* idx, const double* w, int nn, double xi)
+    {
+        __m256d acc = _mm256_setzero_pd();
+        __m256d xiv = _mm256_set1_pd(xi);
+        int k = 0;
+        for (; k + 4 <= nn; k += 4) {
+            __m256d xv = _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i*)(idx + k)), 8);
+            __m256d d = _mm256_sub_pd(xiv, xv);
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(w + k), _mm256_mul_pd(d, d)));
+        }
+        double l[4];
+        _mm256_storeu_pd(l, acc);
+        for (; k < nn; ++k) {
+            double d = xi - x[idx[k]];
+            l[k & 3] += w[k] * (d * d);
+        }
+        return add_lanes(l);
+    }
+
+    bool has_avx2()
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }
+#endif
+
+#ifdef JSGEODA_LISA_SIMD128
+    // no gather in SIMD128: the values are loaded one by one into lanes
+    // (0, 1) and (2, 3)
+    double gather_dot_simd128(const double* x, const int* idx, const double* w, int nn)
+    {
+        v128_t acc01 = wasm_f64x2_splat(0), acc23 = wasm_f64x2_splat(0);
+        int k = 0;
+        for (; k + 4 <= nn; k += 4) {
+            v128_t x01 = wasm_f64x2_make(x[idx[k]], x[idx[k + 1]]);
+            v128_t x23 = wasm_f64x2_make(x[idx[k + 2]], x[idx[k + 3]]);
+            acc01 = wasm_f64x2_add(acc01, wasm_f64x2_mul(wasm_v128_load(w + k), x01));
+            acc23 = wasm_f64x2_add(acc23, wasm_f64x2_mul(wasm_v128_load(w + k + 2), x23));
+        }
+        double l[4] = {wasm_f64x2_extract_lane(acc01, 0), wasm_f64x2_extract_lane(acc01, 1),
+                       wasm_f64x2_extract_lane(acc23, 0), wasm_f64x2_extract_lane(acc23, 1)};
+        for (; k < nn; ++k) l[k & 3] += w[k] * x[idx[k]];
+        return add_lanes(l);
+    }
+
+    double gather_sq_diff_simd128(const double* x, const int* idx, const double* w, int nn, double xi)
+    {
+        v128_t acc01 = wasm_f64x2_splat(0), acc23 = wasm_f64x2_splat(0);
+        v128_t xiv = wasm_f64x2_splat(xi);
+        int k = 0;
+        for (; k + 4 <= nn; k += 4) {
+            v128_t d01 = wasm_f64x2_sub(xiv, wasm_f64x2_make(x[idx[k]], x[idx[k + 1]]));
+            v128_t d23 = wasm_f64x2_sub(xiv, wasm_f64x2_make(x[idx[k + 2]], x[idx[k + 3]]));
+            acc01 = wasm_f64x2_add(acc01, wasm_f64x2_mul(wasm_v128_load(w + k), wasm_f64x2_mul(d01, d01)));
+            acc23 = wasm_f64x2_add(acc23, wasm_f64x2_mul(wasm_v128_load(w + k + 2), wasm_f64x2_mul(d23, d23)));
+        }
+        double l[4] = {wasm_f64x2_extract_lane(acc01, 0), wasm_f64x2_extract_lane(acc01, 1),
+                       wasm_f64x2_extract_lane(acc23, 0), wasm_f64x2_extract_lane(acc23, 1)};
+        for (; k < nn; ++k) {
+            double d = xi - x[idx[k]];
+            l[k & 3] += w[k] * (d * d);
+        }
+        return add_lanes(l);
+    }
+#endif
+
+    struct Kernels {
+        LisaKernelPath path;
+        GatherDotFunc gather_dot;
+        GatherSqDiffFunc gather_sq_diff;
+    };
+
+    bool get_kernels(LisaKernelPath path, Kernels& k)
+    {
+        k.path = path;
+        switch (path) {
+            case LISA_KERNEL_SCALAR:
+                k.gather_dot = gather_dot_scalar;
+                k.gather_sq_diff = gather_sq_diff_scalar;
+                return true;
+#ifdef JSGEODA_LISA_AVX2
+            case LISA_KERNEL_AVX2:
+                if (!has_avx2()) return false;
+                k.gather_dot = gather_dot_avx2;
+                k.gather_sq_diff = gather_sq_diff_avx2;
+                return true;
+#endif
+#ifdef JSGEODA_LISA_SIMD128
+            case LISA_KERNEL_SIMD128:
+                k.gather_dot = gather_dot_simd128;
+                k.gather_sq_diff = gather_sq_diff_simd128;
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    Kernels best_kernels()
+    {
+        Kernels k;
+        if (get_kernels(LISA_KERNEL_SIMD128, k) || get_kernels(LISA_KERNEL_AVX2, k)) return k;
+        get_kernels(LISA_KERNEL_SCALAR, k);
+        return k;
+    }
+
+    Kernels kernels = best_kernels();
+
+    // all paths give the same bits, so short rows (e.g. knn weights), where a
+    // gather does not pay off, stay on the scalar loop
+    const int SIMD_MIN_NN = 48;
+}
+
+double GatherDot(const double* x, const int* idx, const double* w, int nn)
+{
+    if (nn < SIMD_MIN_NN) return gather_dot_scalar(x, idx, w, nn);
+    return kernels.gather_dot(x, idx, w, nn);
+}
+
+double GatherSqDiff(const double* x, const int* idx, const double* w, int nn, double xi)
+{
+    if (nn < SIMD_MIN_NN) return gather_sq_diff_scalar(x, idx, w, nn, xi);
+    return kernels.gather_sq_diff(x, idx, w, nn, xi);
+}
+
+LisaKernelPath GetLisaKernelPath()
+{
+    return kernels.path;
+}
+
+bool SetLisaKernelPath(LisaKernelPath path)
+{
+    Kernels k;
+    if (!get_kernels(path, k)) return false;
+    kernels = k;
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef JSGEODA_LISA_KERNELS_H
+#define JSGEODA_LISA_KERNELS_H
+
+/**
+ * The inner loops of the LISA permutations: sums over nn neighbors of values
+ * gathered at (random) indices.
+ *
+ * The sums are accumulated in 4 lanes (neighbor k goes to lane k % 4) and the
+ * lanes are added as (l0 + l2) + (l1 + l3). Every path uses this order, so the
+ * scalar, AVX2 and WASM SIMD128 kernels give the same bits, and the pseudo
+ * p-values do not depend on the machine.
+ */
+enum LisaKernelPath {
+    LISA_KERNEL_SCALAR = 0,
+    LISA_KERNEL_AVX2 = 1,    // x86 with GCC/Clang, chosen at runtime if the CPU has AVX2
+    LISA_KERNEL_SIMD128 = 2  // WebAssembly built with -msimd128 (see the JSGEODA_SIMD option)
+};
+
+// sum_k w[k] * x[idx[k]]
+double GatherDot(const double* x, const int* idx, const double* w, int nn);
+
+// sum_k w[k] * ((xi - x[idx[k]]) * (xi - x[idx[k]]))
+double GatherSqDiff(const double* x, const int* idx, const double* w, int nn, double xi);
+
+// the kernels in use: the best one available, unless set
+LisaKernelPath GetLisaKernelPath();
+
+// use the kernels of path; false (and no change) if not available here
+bool SetLisaKernelPath(LisaKernelPath path);
+
+#endif //JSGEODA_LISA_KERNELS_H
@@ -0,0 +1,22 @@
+#include "parallel.h"
+
+namespace {
+    int num_threads_setting = 0;
+}
+
+int gda_num_threads()
+{
+#ifndef JSGEODA_HAS_THREADS
+    return 1;
+#else
+    int n = num_threads_setting > 0 ? num_threads_setting : (int)std::thread::hardware_concurrency();
+    if (n < 1) n = 1;
+    if (GDA_MAX_THREADS > 0 && n > GDA_MAX_THREADS) n = GDA_MAX_THREADS;
+    return n;
+#endif
+}
+
+void gda_set_num_threads(int n_threads)
+{
+    num_threads_setting = n_threads > 0 ? n_threads : 0;
+}
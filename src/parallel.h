@@ -0,0 +1,73 @@
+#ifndef JSGEODA_PARALLEL_H
+#define JSGEODA_PARALLEL_H
+
+#include <cstddef>
+#include <vector>
+
+// libgeoda is compiled with __NO_THREAD__ in the wasm build, since its threads
+// depend on boost::thread. The routines in wasmgeoda only need std::thread, and
+// can still run in parallel when the wasm target is built with pthreads
+// (__JSGEODA_THREADS__, see the JSGEODA_PTHREADS option in CMakeLists.txt)
+#if !defined(__NO_THREAD__) || defined(__JSGEODA_THREADS__)
+#define JSGEODA_HAS_THREADS 1
+#include <thread>
+#endif
+
+// in the pthreads wasm build, the workers come from the pool Emscripten
+// creates at startup (-s PTHREAD_POOL_SIZE): a thread beyond the pool can not
+// start while the main thread blocks in join(), so the thread count is capped
+// at the pool size
+#if defined(__JSGEODA_THREADS__) && defined(JSGEODA_PTHREAD_POOL_SIZE)
+const int GDA_MAX_THREADS = JSGEODA_PTHREAD_POOL_SIZE;
+#else
+const int GDA_MAX_THREADS = 0;  // no cap
+#endif
+
+/**
+ * Number of worker threads used by the parallel weights and LISA routines.
+ *
+ * It is always 1 in a single-thread build (the default wasm build). Otherwise
+ * it defaults to the number of hardware threads, and can be changed using
+ * gda_set_num_threads(), up to GDA_MAX_THREADS in the pthreads wasm build.
+ */
+int gda_num_threads();
+
+void gda_set_num_threads(int n_threads);
+
+/**
+ * Split [0, n) into at most n_threads contiguous blocks, and run
+ * func(start, end, thread_id) on each block. The blocks are deterministic
+ * for a given (n, n_threads), so callers can keep per-thread buffers indexed by
+ * thread_id and merge them in order afterwards.
+ *
+ * Returns the number of blocks actually used.
+ */
+template <class Func>
+int gda_parallel_for(size_t n, int n_threads, Func func)
+{
+    if (n_threads < 1) n_threads = 1;
+    if (GDA_MAX_THREADS > 0 && n_threads > GDA_MAX_THREADS) n_threads = GDA_MAX_THREADS;
+    if ((size_t)n_threads > n) n_threads = n > 0 ? (int)n : 1;
+
+#ifdef JSGEODA_HAS_THREADS
+    if (n_threads > 1) {
+        size_t block = n / n_threads;
+        size_t remain = n % n_threads;
+        std::vector<std::thread> workers;
+        size_t start = 0;
+        for (int t = 0; t < n_threads; ++t) {
+            size_t end = start + block + (t < (int)remain ? 1 : 0);
+            workers.push_back(std::thread(func, start, end, t));
+            start = end;
+        }
+        for (size_t t = 0; t < workers.size(); ++t) {
+            workers[t].join();
+        }
+        return n_threads;
+    }
+#endif
+    func((size_t)0, n, 0);
+    return 1;
+}
+
+#endif //JSGEODA_PARALLEL_H
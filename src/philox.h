@@ -0,0 +1,91 @@
+#ifndef JSGEODA_PHILOX_H
+#define JSGEODA_PHILOX_H
+
+#include <cstdint>
+
+/**
+ * Philox4x32
+ *
+ * The Philox4x32-10 counter-based generator (Salmon et al. 2011, "Parallel
+ * random numbers: as easy as 1, 2, 3"). Generate() maps a 128-bit counter to
+ * 128 random bits under a 64-bit key. There is no state between calls, so the
+ * numbers at any counter can be computed directly, by any thread, in any
+ * order.
+ */
+class Philox4x32 {
+public:
+    struct Block {
+        uint32_t v[4];
+    };
+
+    explicit Philox4x32(uint64_t key) : k0((uint32_t)key), k1((uint32_t)(key >> 32)) {}
+
+    Block Generate(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3) const
+    {
+        Block b = {{c0, c1, c2, c3}};
+        uint32_t key0 = k0, key1 = k1;
+        for (int round = 0; round < 10; ++round) {
+            if (round > 0) {
+                key0 += 0x9E3779B9U;
+                key1 += 0xBB67AE85U;
+            }
+            uint64_t p0 = (uint64_t)0xD2511F53U * b.v[0];
+            uint64_t p1 = (uint64_t)0xCD9E8D57U * b.v[2];
+            uint32_t x0 = (uint32_t)(p1 >> 32) ^ b.v[1] ^ key0;
+            uint32_t x2 = (uint32_t)(p0 >> 32) ^ b.v[3] ^ key1;
+            b.v[0] = x0;
+            b.v[1] = (uint32_t)p1;
+            b.v[2] = x2;
+            b.v[3] = (uint32_t)p0;
+        }
+        return b;
+    }
+
+protected:
+    uint32_t k0;
+    uint32_t k1;
+};
+
+/**
+ * PhiloxStream
+ *
+ * The random numbers of one (c1, c2, c3) counter prefix: c0 counts the blocks
+ * of the stream. Two streams with different prefixes are independent, and a
+ * stream is rebuilt from its prefix alone.
+ */
+class PhiloxStream {
+public:
+    PhiloxStream(const Philox4x32& philox, uint32_t c1, uint32_t c2, uint32_t c3)
+    : philox(philox), c1(c1), c2(c2), c3(c3), block_idx(0), used(4) {}
+
+    uint32_t Next32()
+    {
+        if (used == 4) {
+            block = philox.Generate(block_idx++, c1, c2, c3);
+            used = 0;
+        }
+        return block.v[used++];
+    }
+
+    // uniform integer in [0, range), range > 0: Lemire's multiply-shift, with
+    // the rare biased products rejected
+    int NextInt(int range)
+    {
+        uint32_t r = (uint32_t)range;
+        uint64_t m = (uint64_t)Next32() * r;
+        if ((uint32_t)m < r) {
+            uint32_t threshold = (0U - r) % r;
+            while ((uint32_t)m < threshold) m = (uint64_t)Next32() * r;
+        }
+        return (int)(m >> 32);
+    }
+
+protected:
+    const Philox4x32& philox;
+    uint32_t c1, c2, c3;
+    uint32_t block_idx;
+    int used;
+    Philox4x32::Block block;
+};
+
+#endif //JSGEODA_PHILOX_H
@@ -0,0 +1,273 @@
+#include "../libgeoda_src/weights/GeodaWeight.h"
+#include "spatial_lag.h"
+
+namespace {
+
+    // sum of data over the neighbors; divided by the row size if ROW_STAND
+    template <bool ROW_STAND, class Rows>
+    void binary_lag(const Rows& rows, const std::vector<size_t>& row_sizes, const std::vector<double>& data,
+                    std::vector<double>& lag)
+    {
+        int num_obs = (int)lag.size();
+        for (int i = 0; i < num_obs; ++i) {
+            double sum = 0;
+            for (typename Rows::Cursor c = rows.Row(i); c.Next();) {
+                sum += data[c.Nbr()];
+            }
+            if (ROW_STAND) {
+                size_t nn = row_sizes[i];
+                sum = nn > 0 ? sum / nn : sum;
+            }
+            lag[i] = sum;
+        }
+    }
+
+    // sum of data times the row-standardized weights
+    template <class Rows, class Values>
+    void weighted_lag(const Rows& rows, const Values& row_std, const std::vector<double>& data,
+                      std::vector<double>& lag)
+    {
+        int num_obs = (int)lag.size();
+        for (int i = 0; i < num_obs; ++i) {
+            double sum = 0;
+            for (typename Rows::Cursor c = rows.Row(i); c.Next();) {
+                sum += data[c.Nbr()] * row_std(i, c);
+            }
+            lag[i] = sum;
+        }
+    }
+}
+
+LagWeights::LagWeights(GeoDaWeight* w, const SpatialOrder& so, bool use_compact,
+                       const std::shared_ptr<const KernelSpec>& kernel_spec)
+: num_obs(w->num_obs), spatial_order(so), is_compact(use_compact), is_implicit(false), has_weights(false),
+  has_diagonal(false), has_offdiag(false)
+{
+    csr.num_obs = num_obs;
+    csr.is_symmetric = w->is_symmetric;
+    csr.offsets.resize(num_obs + 1, 0);
+
+    // the weight values of implicit weights are evaluated from the kernel:
+    // only the ids are kept
+    is_implicit = kernel_spec != 0 && kernel_spec->GetNumObs() == num_obs;
+
+    std::vector<std::vector<double> > row_weights(num_obs);
+    for (int i = 0; i < num_obs; ++i) {
+        const std::vector<long> nbrs = w->GetNeighbors(i);
+        if (!is_implicit) row_weights[i] = w->GetNeighborWeights(i);
+        if (!row_weights[i].empty()) has_weights = true;
+        csr.nbrs.insert(csr.nbrs.end(), nbrs.begin(), nbrs.end());
+        csr.offsets[i + 1] = csr.nbrs.size();
+    }
+    if (is_implicit) {
+        has_weights = true;
+        kernel = kernel_spec;
+    } else if (has_weights) {
+        csr.weights.reserve(csr.nbrs.size());
+        for (int i = 0; i < num_obs; ++i) {
+            size_t nn = csr.GetNbrSize(i);
+            row_weights[i].resize(nn, 1.0);
+            csr.weights.insert(csr.weights.end(), row_weights[i].begin(), row_weights[i].end());
+        }
+    }
+    if (!spatial_order.IsEmpty()) {
+        csr = ReorderCSR(csr, spatial_order);
+    }
+
+    diagonal_mask.resize(num_obs, 0);
+    for (int i = 0; i < num_obs; ++i) {
+        for (size_t k = csr.offsets[i]; k < csr.offsets[i + 1]; ++k) {
+            if (csr.nbrs[k] == i) diagonal_mask[i] = 1;
+        }
+        if (diagonal_mask[i]) has_diagonal = true;
+    }
+
+    if (is_compact) {
+        compact = CSRToCompact(csr, true);
+        csr = WeightsCSR();
+    }
+}
+
+LagWeights::Variant& LagWeights::getVariant(bool include_diagonal)
+{
+    // without a diagonal both variants are the same
+    return include_diagonal || !has_diagonal ? with_diag : without_diag;
+}
+
+WeightsCSR LagWeights::makeOffDiagonal()
+{
+    WeightsCSR rows;
+    rows.num_obs = num_obs;
+    rows.offsets.resize(num_obs + 1, 0);
+    // implicit weights keep the ids only
+    bool store_values = has_weights && !is_implicit;
+    this->VisitRows(true, false, [&](auto all_rows, auto values) {
+        for (int i = 0; i < num_obs; ++i) {
+            for (auto c = all_rows.Row(i); c.Next();) {
+                if (c.Nbr() == i) continue;
+                rows.nbrs.push_back(c.Nbr());
+                if (store_values) rows.weights.push_back(values(i, c));
+            }
+            rows.offsets[i + 1] = rows.nbrs.size();
+        }
+    });
+    return rows;
+}
+
+const WeightsCSR& LagWeights::getCSR(bool include_diagonal)
+{
+    if (include_diagonal || !has_diagonal) {
+        return csr;
+    }
+    if (!has_offdiag) {
+        offdiag_csr = this->makeOffDiagonal();
+        offdiag_csr.is_symmetric = csr.is_symmetric;
+        has_offdiag = true;
+    }
+    return offdiag_csr;
+}
+
+const CompactCSR& LagWeights::getCompact(bool include_diagonal)
+{
+    if (include_diagonal || !has_diagonal) {
+        return compact;
+    }
+    if (!has_offdiag) {
+        offdiag_compact = CSRToCompact(this->makeOffDiagonal(), compact.is_varint);
+        has_offdiag = true;
+    }
+    return offdiag_compact;
+}
+
+const std::vector<double>& LagWeights::GetRowSums(bool include_diagonal)
+{
+    Variant& v = this->getVariant(include_diagonal);
+    if (!v.has_row_sums) {
+        v.row_sums.resize(num_obs, 0);
+        this->VisitRows(include_diagonal, false, [&](auto rows, auto values) {
+            for (int i = 0; i < num_obs; ++i) {
+                double sum = 0;
+                for (auto c = rows.Row(i); c.Next();) {
+                    sum += values(i, c);
+                }
+                v.row_sums[i] = sum;
+            }
+        });
+        v.has_row_sums = true;
+    }
+    return v.row_sums;
+}
+
+namespace {
+    template <class Rows, class Values, class T>
+    void row_standardize(const Rows& rows, const Values& values, const std::vector<double>& row_sums, size_t nnz,
+                         std::vector<T>& row_std)
+    {
+        row_std.resize(nnz, 0);
+        for (int i = 0; i < (int)row_sums.size(); ++i) {
+            if (row_sums[i] == 0) continue;
+            for (typename Rows::Cursor c = rows.Row(i); c.Next();) {
+                row_std[c.Pos()] = (T)(values(i, c) / row_sums[i]);
+            }
+        }
+    }
+}
+
+template <>
+const std::vector<double>& LagWeights::getRowStandardized<double>(bool include_diagonal)
+{
+    Variant& v = this->getVariant(include_diagonal);
+    if (!v.has_row_std) {
+        const std::vector<double>& row_sums = this->GetRowSums(include_diagonal);
+        size_t nnz = this->getCSR(include_diagonal).nbrs.size();
+        this->VisitRows(include_diagonal, false, [&](auto rows, auto values) {
+            row_standardize(rows, values, row_sums, nnz, v.row_std);
+        });
+        v.has_row_std = true;
+    }
+    return v.row_std;
+}
+
+template <>
+const std::vector<float>& LagWeights::getRowStandardized<float>(bool include_diagonal)
+{
+    Variant& v = this->getVariant(include_diagonal);
+    if (!v.has_row_std) {
+        const std::vector<double>& row_sums = this->GetRowSums(include_diagonal);
+        size_t nnz = this->getCompact(include_diagonal).offsets[num_obs];
+        this->VisitRows(include_diagonal, false, [&](auto rows, auto values) {
+            row_standardize(rows, values, row_sums, nnz, v.row_std_float);
+        });
+        v.has_row_std = true;
+    }
+    return v.row_std_float;
+}
+
+const std::vector<double>& LagWeights::getRowScale(bool include_diagonal)
+{
+    Variant& v = this->getVariant(include_diagonal);
+    if (!v.has_row_std) {
+        const std::vector<double>& row_sums = this->GetRowSums(include_diagonal);
+        v.row_std.resize(num_obs, 0);
+        for (int i = 0; i < num_obs; ++i) {
+            if (row_sums[i] != 0) v.row_std[i] = 1.0 / row_sums[i];
+        }
+        v.has_row_std = true;
+    }
+    return v.row_std;
+}
+
+size_t LagWeights::GetMemorySize() const
+{
+    size_t rows_size, value_size;
+    if (is_compact) {
+        rows_size = compact.GetMemorySize();
+        value_size = sizeof(float);
+    } else {
+        rows_size = (csr.offsets.size() * sizeof(size_t) + csr.nbrs.size() * sizeof(long) +
+                     csr.weights.size() * sizeof(double));
+        value_size = sizeof(double);
+    }
+    size_t nnz = is_compact ? compact.offsets[num_obs] : csr.nbrs.size();
+    // the variants: row sums and row-standardized values (row scales if
+    // implicit), with and without the diagonal, and the off-diagonal rows
+    size_t std_size = is_implicit ? num_obs * sizeof(double) : nnz * value_size;
+    size_t size = rows_size + 2 * (num_obs * sizeof(double) + std_size);
+    if (has_diagonal) size += rows_size;
+    size += spatial_order.order.size() * 2 * sizeof(int) + diagonal_mask.size();
+    return size;
+}
+
+std::vector<double> SpatialLag(LagWeights& w, const std::vector<double>& data, bool is_binary, bool row_stand,
+                               bool inc_diag)
+{
+    int num_obs = w.GetNumObs();
+    std::vector<double> lag(num_obs, 0);
+    if ((int)data.size() < num_obs) {
+        return std::vector<double>();
+    }
+    const SpatialOrder& so = w.GetSpatialOrder();
+    std::vector<double> ordered_data;
+    if (!so.IsEmpty()) ordered_data = ToSpatialOrder(data, so);
+    const std::vector<double>& values = so.IsEmpty() ? data : ordered_data;
+
+    if (is_binary || !w.HasWeightValues()) {
+        if (row_stand) {
+            // divided by the number of neighbors including the diagonal
+            std::vector<size_t> row_sizes(num_obs);
+            for (int i = 0; i < num_obs; ++i) row_sizes[i] = w.GetNbrSize(i);
+            w.VisitRows(inc_diag, false, [&](auto rows, auto) {
+                binary_lag<true>(rows, row_sizes, values, lag);
+            });
+        } else {
+            w.VisitRows(inc_diag, false, [&](auto rows, auto) {
+                binary_lag<false>(rows, std::vector<size_t>(), values, lag);
+            });
+        }
+    } else {
+        w.VisitRows(inc_diag, true, [&](auto rows, auto row_std) {
+            weighted_lag(rows, row_std, values, lag);
+        });
+    }
+    return FromSpatialOrder(lag, so);
+}
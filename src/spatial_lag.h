@@ -0,0 +1,266 @@
+#ifndef JSGEODA_SPATIAL_LAG_H
+#define JSGEODA_SPATIAL_LAG_H
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "compact_csr.h"
+#include "kernel_weights.h"
+#include "spatial_order.h"
+#include "sphere.h"
+#include "weights_csr.h"
+
+class GeoDaWeight;
+
+/**
+ * Weight values passed by LagWeights::VisitRows(): values(i, c) is the weight
+ * of row i at the cursor c of the row view.
+ */
+
+// stored values (double, or float if compact), aligned with Pos() of the rows
+template <class T>
+struct ArrayValues {
+    const T* vals;
+
+    explicit ArrayValues(const T* vals) : vals(vals) {}
+
+    template <class Cursor>
+    double operator()(int, const Cursor& c) const { return vals[c.Pos()]; }
+};
+
+// binary weights
+struct UnitValues {
+    template <class Cursor>
+    double operator()(int, const Cursor&) const { return 1.0; }
+};
+
+// implicit kernel weights, evaluated from the distance of i and its neighbor,
+// and multiplied by row_scale[i] (e.g. 1 / row sum) unless row_scale is null
+template <KernelType K>
+struct KernelValues {
+    const double* coords;
+    const double* bandwidths;
+    bool is_adaptive;
+    bool is_arc;
+    bool is_mile;
+    double diagonal;
+    const double* row_scale;
+
+    KernelValues(const KernelSpec& spec, const double* row_scale)
+    : coords(spec.coords.data()), bandwidths(spec.bandwidths.data()), is_adaptive(spec.bandwidths.size() > 1),
+      is_arc(spec.is_arc), is_mile(spec.is_mile), diagonal(spec.GetDiagonal()), row_scale(row_scale) {}
+
+    template <class Cursor>
+    double operator()(int i, const Cursor& c) const
+    {
+        long j = c.Nbr();
+        double val = diagonal;
+        if (j != i) {
+            const double* p = coords + (size_t)i * 3;
+            const double* q = coords + (size_t)j * 3;
+            double d2 = 0;
+            for (int k = 0; k < 3; ++k) {
+                double diff = p[k] - q[k];
+                d2 += diff * diff;
+            }
+            double d = is_arc ? ChordToArcDistance(std::sqrt(d2), is_mile) : std::sqrt(d2);
+            double bandwidth = bandwidths[is_adaptive ? i : 0];
+            val = bandwidth > 0 ? KernelFunc<K>::Value(d / bandwidth) : 0;
+        }
+        return row_scale ? val * row_scale[i] : val;
+    }
+};
+
+/**
+ * LagWeights
+ *
+ * The weights in CSR layout, with the variants needed to compute spatial lags
+ * derived once and cached: the row sums, the row-standardized values, and the
+ * rows without the diagonal (e.g. kernel weights include each observation as
+ * its own neighbor). Each variant is computed on first use.
+ *
+ * With a spatial order, the rows and neighbor ids are renumbered by it, and
+ * the rows, the variants and the diagonal mask are all in spatial order.
+ * SpatialLag() takes and returns values in file order either way.
+ *
+ * If compact, the rows are stored as CompactCSR (32-bit or varint ids, float
+ * weights) and the row-standardized values as float. The kernels read the
+ * compact rows directly through VisitRows().
+ *
+ * If implicit (a KernelSpec is given for kernel weights), only the neighbor
+ * ids are stored: the weight values are evaluated on the fly from the
+ * centroids and bandwidths of the KernelSpec, and the row-standardized
+ * variant is one scale per row instead of one value per neighbor. The
+ * KernelSpec is in the order of the rows (so), and shared, not copied: the
+ * weights cache keeps the only one.
+ *
+ * The getters are not thread-safe on first call: call them before starting
+ * threads that read the variants.
+ */
+class LagWeights {
+public:
+    LagWeights(GeoDaWeight* w, const SpatialOrder& so = SpatialOrder(), bool use_compact = false,
+               const std::shared_ptr<const KernelSpec>& kernel_spec = nullptr);
+
+    int GetNumObs() const { return num_obs; }
+
+    // the order of the rows (empty for file order)
+    const SpatialOrder& GetSpatialOrder() const { return spatial_order; }
+
+    bool IsCompact() const { return is_compact; }
+
+    bool IsImplicit() const { return is_implicit; }
+
+    // the kernel of implicit weights (0 if not implicit)
+    const KernelSpec* GetKernelSpec() const { return kernel.get(); }
+
+    // false if the weights have no weight values (e.g. gal)
+    bool HasWeightValues() const { return has_weights; }
+
+    // true if any row has the observation itself as neighbor
+    bool HasDiagonal() const { return has_diagonal; }
+
+    // 1 for the observations that are their own neighbor
+    const std::vector<unsigned char>& GetDiagonalMask() const { return diagonal_mask; }
+
+    // number of neighbors of row i, including the diagonal
+    size_t GetNbrSize(int i) const { return is_compact ? compact.GetNbrSize(i) : csr.GetNbrSize(i); }
+
+    // the sum of weight values (or the number of neighbors) of each row
+    const std::vector<double>& GetRowSums(bool include_diagonal);
+
+    /**
+     * Call func(rows, values) with a row view (CSRRows, Int32Rows or
+     * VarintRows) of the rows with or without the diagonal, and their weight
+     * values: ArrayValues, UnitValues (binary weights) or KernelValues
+     * (implicit weights). The values are row-standardized if
+     * row_standardized, otherwise the original ones.
+     */
+    template <class Func>
+    void VisitRows(bool include_diagonal, bool row_standardized, Func func)
+    {
+        if (!is_compact) {
+            const WeightsCSR& rows = this->getCSR(include_diagonal);
+            this->visitRows(MakeRows(rows), rows.weights, include_diagonal, row_standardized, func);
+        } else {
+            const CompactCSR& rows = this->getCompact(include_diagonal);
+            if (rows.is_varint) {
+                this->visitRows(MakeVarintRows(rows), rows.weights, include_diagonal, row_standardized, func);
+            } else {
+                this->visitRows(MakeInt32Rows(rows), rows.weights, include_diagonal, row_standardized, func);
+            }
+        }
+    }
+
+    // memory of the rows and estimated memory of all variants in bytes
+    size_t GetMemorySize() const;
+
+protected:
+    struct Variant {
+        bool has_row_sums;
+        bool has_row_std;
+        std::vector<double> row_sums;
+        std::vector<double> row_std;        // one scale per row if implicit
+        std::vector<float> row_std_float;
+
+        Variant() : has_row_sums(false), has_row_std(false) {}
+    };
+
+    int num_obs;
+    SpatialOrder spatial_order;
+    bool is_compact;
+    bool is_implicit;
+    bool has_weights;
+    bool has_diagonal;
+    std::vector<unsigned char> diagonal_mask;
+
+    // the kernel of implicit weights, with coords and bandwidths in the order
+    // of the rows
+    std::shared_ptr<const KernelSpec> kernel;
+
+    // the rows: csr, or compact if is_compact (ids only if is_implicit)
+    WeightsCSR csr;
+    CompactCSR compact;
+
+    bool has_offdiag;
+    WeightsCSR offdiag_csr;
+    CompactCSR offdiag_compact;
+
+    Variant with_diag;
+    Variant without_diag;
+
+    Variant& getVariant(bool include_diagonal);
+
+    const WeightsCSR& getCSR(bool include_diagonal);
+
+    const CompactCSR& getCompact(bool include_diagonal);
+
+    // the rows without the diagonal, in full layout
+    WeightsCSR makeOffDiagonal();
+
+    // row-standardized values in the value type of the rows (double or float)
+    template <class T>
+    const std::vector<T>& getRowStandardized(bool include_diagonal);
+
+    // 1 / row sum of each row of implicit weights
+    const std::vector<double>& getRowScale(bool include_diagonal);
+
+    template <class Rows, class T, class Func>
+    void visitRows(const Rows& rows, const std::vector<T>& weights, bool include_diagonal, bool row_standardized,
+                   Func& func)
+    {
+        if (is_implicit) {
+            const double* row_scale = row_standardized ? this->getRowScale(include_diagonal).data() : 0;
+            switch (kernel->kernel_type) {
+                case KERNEL_TRIANGULAR:
+                    func(rows, KernelValues<KERNEL_TRIANGULAR>(*kernel, row_scale));
+                    break;
+                case KERNEL_UNIFORM:
+                    func(rows, KernelValues<KERNEL_UNIFORM>(*kernel, row_scale));
+                    break;
+                case KERNEL_EPANECHNIKOV:
+                    func(rows, KernelValues<KERNEL_EPANECHNIKOV>(*kernel, row_scale));
+                    break;
+                case KERNEL_QUARTIC:
+                    func(rows, KernelValues<KERNEL_QUARTIC>(*kernel, row_scale));
+                    break;
+                case KERNEL_GAUSSIAN:
+                    func(rows, KernelValues<KERNEL_GAUSSIAN>(*kernel, row_scale));
+                    break;
+            }
+        } else if (row_standardized) {
+            func(rows, ArrayValues<T>(this->getRowStandardized<T>(include_diagonal).data()));
+        } else if (has_weights) {
+            func(rows, ArrayValues<T>(weights.data()));
+        } else {
+            func(rows, UnitValues());
+        }
+    }
+};
+
+template <>
+const std::vector<double>& LagWeights::getRowStandardized<double>(bool include_diagonal);
+
+template <>
+const std::vector<float>& LagWeights::getRowStandardized<float>(bool include_diagonal);
+
+/**
+ * Spatial lag of data.
+ *
+ * Binary (is_binary, or weights without weight values): the sum of the values
+ * of the neighbors, divided by the number of neighbors if row_stand.
+ * Otherwise: the average of the values of the neighbors weighted by the
+ * row-standardized weights.
+ *
+ * The diagonal is skipped unless inc_diag. (The row-standardized binary lag
+ * divides by the number of neighbors including the diagonal, as before.)
+ *
+ * Each mode, row layout and kind of weight values (stored, or a kernel of
+ * implicit weights) runs a loop specialized at compile time, which reads the
+ * cached variants of the weights without any per-neighbor dispatch.
+ */
+std::vector<double> SpatialLag(LagWeights& w, const std::vector<double>& data, bool is_binary, bool row_stand,
+                               bool inc_diag);
+
+#endif //JSGEODA_SPATIAL_LAG_H
@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <utility>
+
+#include "spatial_order.h"
+
+SpatialOrder MakeSpatialOrder(const std::vector<int>& order)
+{
+    SpatialOrder so;
+    so.order = order;
+    so.rank.resize(order.size());
+    for (size_t p = 0; p < order.size(); ++p) {
+        so.rank[order[p]] = (int)p;
+    }
+    return so;
+}
+
+WeightsCSR ReorderCSR(const WeightsCSR& csr, const SpatialOrder& so)
+{
+    if (so.IsEmpty()) return csr;
+
+    WeightsCSR result;
+    result.num_obs = csr.num_obs;
+    result.is_symmetric = csr.is_symmetric;
+    result.offsets.resize(csr.num_obs + 1, 0);
+    result.nbrs.reserve(csr.nbrs.size());
+    bool has_weights = !csr.weights.empty();
+    if (has_weights) result.weights.reserve(csr.weights.size());
+
+    std::vector<std::pair<long, double> > row;
+    for (int p = 0; p < csr.num_obs; ++p) {
+        int i = so.order[p];
+        row.clear();
+        for (size_t k = csr.offsets[i]; k < csr.offsets[i + 1]; ++k) {
+            row.push_back(std::make_pair((long)so.rank[csr.nbrs[k]], has_weights ? csr.weights[k] : 1.0));
+        }
+        std::sort(row.begin(), row.end());
+        for (size_t k = 0; k < row.size(); ++k) {
+            result.nbrs.push_back(row[k].first);
+            if (has_weights) result.weights.push_back(row[k].second);
+        }
+        result.offsets[p + 1] = result.nbrs.size();
+    }
+    return result;
+}
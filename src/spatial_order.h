@@ -0,0 +1,56 @@
+#ifndef JSGEODA_SPATIAL_ORDER_H
+#define JSGEODA_SPATIAL_ORDER_H
+
+#include <vector>
+
+#include "weights_csr.h"
+
+/**
+ * SpatialOrder
+ *
+ * A renumbering of the observations, e.g. along the Hilbert curve of their
+ * centroids (see HilbertOrder()): observations that are close in space get
+ * close positions, so the neighbors of a row are close in memory as well.
+ *
+ * An empty SpatialOrder is the file order.
+ */
+struct SpatialOrder {
+    std::vector<int> order; // position -> original id
+    std::vector<int> rank;  // original id -> position
+
+    bool IsEmpty() const { return order.empty(); }
+};
+
+SpatialOrder MakeSpatialOrder(const std::vector<int>& order);
+
+/**
+ * The weights with rows and neighbor ids renumbered by the spatial order. The
+ * neighbors of each row are sorted by their new id.
+ */
+WeightsCSR ReorderCSR(const WeightsCSR& csr, const SpatialOrder& so);
+
+// values of the observations in file order -> in spatial order
+template <class T>
+std::vector<T> ToSpatialOrder(const std::vector<T>& values, const SpatialOrder& so)
+{
+    if (so.IsEmpty()) return values;
+    std::vector<T> result(so.order.size());
+    for (size_t p = 0; p < so.order.size(); ++p) {
+        result[p] = values[so.order[p]];
+    }
+    return result;
+}
+
+// values of the observations in spatial order -> in file order
+template <class T>
+std::vector<T> FromSpatialOrder(const std::vector<T>& values, const SpatialOrder& so)
+{
+    if (so.IsEmpty()) return values;
+    std::vector<T> result(so.order.size());
+    for (size_t p = 0; p < so.order.size(); ++p) {
+        result[so.order[p]] = values[p];
+    }
+    return result;
+}
+
+#endif //JSGEODA_SPATIAL_ORDER_H
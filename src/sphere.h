@@ -0,0 +1,55 @@
+#ifndef JSGEODA_SPHERE_H
+#define JSGEODA_SPHERE_H
+
+#include <cmath>
+#include <vector>
+
+// Earth radius used by GeoDa for arc distances
+const double EARTH_RADIUS_KM = 6371.0;
+const double EARTH_RADIUS_MILE = 3958.760;
+
+/**
+ * Convert longitude/latitude points (in degrees) to 3D points on the unit
+ * sphere: coords holds n * 3 values, point i is coords[i*3 .. i*3+3).
+ *
+ * The straight-line (chord) distance between two unit vectors is monotone in
+ * their great-circle distance, so nearest neighbor and fixed-radius searches
+ * can run in 3D Euclidean space and still be exact.
+ */
+inline std::vector<double> LonLatToUnitVectors(const std::vector<double>& lon, const std::vector<double>& lat)
+{
+    const double deg2rad = M_PI / 180.0;
+    std::vector<double> coords(lon.size() * 3);
+    for (size_t i = 0; i < lon.size(); ++i) {
+        double lo = lon[i] * deg2rad, la = lat[i] * deg2rad;
+        coords[i * 3] = std::cos(la) * std::cos(lo);
+        coords[i * 3 + 1] = std::cos(la) * std::sin(lo);
+        coords[i * 3 + 2] = std::sin(la);
+    }
+    return coords;
+}
+
+/**
+ * Great-circle distance in km (or miles) of a chord on the unit sphere
+ */
+inline double ChordToArcDistance(double chord, bool is_mile)
+{
+    double half = chord / 2.0;
+    if (half > 1.0) half = 1.0;
+    double radius = is_mile ? EARTH_RADIUS_MILE : EARTH_RADIUS_KM;
+    return 2.0 * std::asin(half) * radius;
+}
+
+/**
+ * Chord on the unit sphere of a great-circle distance in km (or miles)
+ */
+inline double ArcDistanceToChord(double dist, bool is_mile)
+{
+    double radius = is_mile ? EARTH_RADIUS_MILE : EARTH_RADIUS_KM;
+    double angle = dist / radius;
+    // beyond half the circumference every point is within the distance
+    if (angle >= M_PI) return 2.0;
+    return 2.0 * std::sin(angle / 2.0);
+}
+
+#endif //JSGEODA_SPHERE_H
@@ -0,0 +1,342 @@
+#include <cstdio>
+#include <stdint.h>
+
+#include "../libgeoda_src/weights/GeodaWeight.h"
+#include "kernel_weights.h"
+#include "spatial_lag.h"
+#include "weights_cache.h"
+#include "weights_components.h"
+
+namespace {
+    size_t weights_budget = 256 * 1024 * 1024;
+
+    uint64_t fnv1a64(const std::string& s)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < s.size(); ++i) {
+            h ^= (unsigned char)s[i];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // the kernel spec in the spatial order from, in the spatial order to
+    // (empty orders: file order)
+    std::shared_ptr<const KernelSpec> reorder_kernel(const KernelSpec& spec, const std::vector<int>& from,
+                                                     const std::vector<int>& to)
+    {
+        int num_obs = spec.GetNumObs();
+        std::vector<int> rank(from.size());
+        for (size_t p = 0; p < from.size(); ++p) rank[from[p]] = (int)p;
+
+        std::shared_ptr<KernelSpec> out = std::make_shared<KernelSpec>();
+        out->kernel_type = spec.kernel_type;
+        out->use_kernel_diagonals = spec.use_kernel_diagonals;
+        out->is_arc = spec.is_arc;
+        out->is_mile = spec.is_mile;
+        out->coords.resize(spec.coords.size());
+        out->bandwidths.resize(spec.bandwidths.size());
+        bool is_adaptive = spec.bandwidths.size() > 1;
+        if (!is_adaptive) out->bandwidths = spec.bandwidths;
+        for (int p = 0; p < num_obs; ++p) {
+            int f = to.empty() ? p : to[p];
+            int q = from.empty() ? f : rank[f];
+            for (int k = 0; k < 3; ++k) out->coords[p * 3 + k] = spec.coords[q * 3 + k];
+            if (is_adaptive) out->bandwidths[p] = spec.bandwidths[q];
+        }
+        return out;
+    }
+}
+
+WeightsParams::WeightsParams(const std::string& weights_type, const std::string& map_id)
+: weights_type(weights_type)
+{
+    canonical = weights_type;
+    this->Add("map", map_id);
+}
+
+WeightsParams& WeightsParams::Add(const char* name, double val)
+{
+    // %.17g round-trips a double, and prints integers and bools without noise
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", val == 0 ? 0.0 : val);
+    canonical += "|";
+    canonical += name;
+    canonical += "=";
+    canonical += buf;
+    return *this;
+}
+
+WeightsParams& WeightsParams::Add(const char* name, const std::string& val)
+{
+    canonical += "|";
+    canonical += name;
+    canonical += "=";
+    canonical += std::to_string(val.size()); // length prefix: no ambiguity with '|' in values
+    canonical += ":";
+    canonical += val;
+    return *this;
+}
+
+std::string WeightsParams::GetUid() const
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)fnv1a64(canonical));
+    return "w_" + weights_type + "_" + buf;
+}
+
+WeightsCache::WeightsCache()
+: total_size(0)
+{
+}
+
+WeightsCache::~WeightsCache()
+{
+    std::map<std::string, Entry>::iterator it;
+    for (it = entries.begin(); it != entries.end(); ++it) {
+        delete it->second.w;
+        delete it->second.lag;
+        delete it->second.components;
+    }
+}
+
+GeoDaWeight* WeightsCache::Get(const std::string& uid)
+{
+    std::map<std::string, Entry>::iterator it = entries.find(uid);
+    if (it == entries.end()) {
+        return 0;
+    }
+    if (it->second.w == 0) {
+        return this->load(uid);
+    }
+    // move to the front of the lru list
+    lru.splice(lru.begin(), lru, it->second.lru_pos);
+    return it->second.w;
+}
+
+GeoDaWeight* WeightsCache::GetOrCreate(const std::string& uid, const Builder& builder)
+{
+    if (entries.find(uid) == entries.end()) {
+        Entry entry;
+        entry.w = 0;
+        entry.lag = 0;
+        entry.components = 0;
+        entry.size = 0;
+        entry.builder = builder;
+        entries[uid] = entry;
+    }
+    return this->Get(uid);
+}
+
+bool WeightsCache::Free(const std::string& uid)
+{
+    std::map<std::string, Entry>::iterator it = entries.find(uid);
+    if (it == entries.end()) {
+        return false;
+    }
+    if (it->second.w) {
+        lru.erase(it->second.lru_pos);
+        this->unload(it->second);
+    }
+    entries.erase(it);
+    return true;
+}
+
+LagWeights* WeightsCache::GetLagWeights(const std::string& uid, const SpatialOrder& so, bool compact, bool implicit)
+{
+    GeoDaWeight* w = this->Get(uid);
+    if (w == 0) {
+        return 0;
+    }
+    Entry& entry = entries[uid];
+    bool is_implicit = implicit && entry.kernel != nullptr;
+    if (entry.lag && (entry.lag->GetSpatialOrder().order != so.order || entry.lag->IsCompact() != compact ||
+                      entry.lag->IsImplicit() != is_implicit)) {
+        // the spatial order or the layout of the map was changed
+        total_size -= entry.lag->GetMemorySize();
+        entry.size -= entry.lag->GetMemorySize();
+        delete entry.lag;
+        entry.lag = 0;
+    }
+    if (entry.lag == 0) {
+        if (is_implicit && entry.kernel_order != so.order) {
+            // the only copy of the kernel follows the order of the rows of
+            // the implicit LagWeights, which share it
+            entry.kernel = reorder_kernel(*entry.kernel, entry.kernel_order, so.order);
+            entry.kernel_order = so.order;
+        }
+        entry.lag = new LagWeights(w, so, compact, is_implicit ? entry.kernel : nullptr);
+        size_t lag_size = entry.lag->GetMemorySize();
+        entry.size += lag_size;
+        total_size += lag_size;
+        this->evict(uid);
+    }
+    return entry.lag;
+}
+
+void WeightsCache::SetKernelSpec(const std::string& uid, const KernelSpec& kernel)
+{
+    std::map<std::string, Entry>::iterator it = entries.find(uid);
+    if (it == entries.end()) {
+        return;
+    }
+    Entry& entry = it->second;
+    size_t kernel_size = sizeof(KernelSpec) + (kernel.coords.size() + kernel.bandwidths.size()) * sizeof(double);
+    if (entry.kernel) {
+        size_t old_size = sizeof(KernelSpec) +
+                (entry.kernel->coords.size() + entry.kernel->bandwidths.size()) * sizeof(double);
+        entry.size -= old_size;
+        total_size -= old_size;
+    }
+    // a LagWeights of the old kernel is built again on next use
+    if (entry.lag && entry.lag->IsImplicit()) {
+        total_size -= entry.lag->GetMemorySize();
+        entry.size -= entry.lag->GetMemorySize();
+        delete entry.lag;
+        entry.lag = 0;
+    }
+    entry.kernel = std::make_shared<const KernelSpec>(kernel);
+    entry.kernel_order.clear();
+    // the builder sets the kernel before the weights are loaded, and load()
+    // evicts for both
+    entry.size += kernel_size;
+    total_size += kernel_size;
+}
+
+const KernelSpec* WeightsCache::GetKernelSpec(const std::string& uid) const
+{
+    std::map<std::string, Entry>::const_iterator it = entries.find(uid);
+    return it == entries.end() ? 0 : it->second.kernel.get();
+}
+
+void WeightsCache::SetSideData(const std::string& key, size_t size, const std::function<void()>& release)
+{
+    std::map<std::string, SideEntry>::iterator it = side_entries.find(key);
+    if (it != side_entries.end()) {
+        total_size -= it->second.size;
+        lru.erase(it->second.lru_pos);
+    }
+    SideEntry& side = side_entries[key];
+    side.size = size;
+    side.release = release;
+    lru.push_front(key);
+    side.lru_pos = lru.begin();
+    total_size += size;
+    this->evict(key);
+}
+
+bool WeightsCache::UseSideData(const std::string& key)
+{
+    std::map<std::string, SideEntry>::iterator it = side_entries.find(key);
+    if (it == side_entries.end()) {
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second.lru_pos);
+    return true;
+}
+
+const WeightsComponents* WeightsCache::GetComponents(const std::string& uid)
+{
+    GeoDaWeight* w = this->Get(uid);
+    if (w == 0) {
+        return 0;
+    }
+    Entry& entry = entries[uid];
+    if (entry.components == 0) {
+        entry.components = new WeightsComponents(FindComponents(w));
+        size_t comp_size = sizeof(WeightsComponents) + (entry.components->labels.size() +
+                entry.components->sizes.size() + entry.components->islands.size()) * sizeof(int);
+        entry.size += comp_size;
+        total_size += comp_size;
+        this->evict(uid);
+    }
+    return entry.components;
+}
+
+size_t WeightsCache::GetEntrySize(const std::string& uid) const
+{
+    std::map<std::string, Entry>::const_iterator it = entries.find(uid);
+    return it == entries.end() ? 0 : it->second.size;
+}
+
+void WeightsCache::SetBudget(size_t bytes)
+{
+    weights_budget = bytes;
+}
+
+size_t WeightsCache::GetBudget()
+{
+    return weights_budget;
+}
+
+GeoDaWeight* WeightsCache::load(const std::string& uid)
+{
+    // the builder can create other weights of this cache (e.g. higher-order
+    // contiguity from first-order), so look the entry up again afterwards
+    GeoDaWeight* w = entries[uid].builder();
+    if (w == 0) {
+        this->unload(entries[uid]);
+        return 0;
+    }
+    w->uid = uid;
+
+    Entry& entry = entries[uid];
+    entry.w = w;
+    size_t w_size = EstimateWeightsSize(w);
+    entry.size += w_size;
+    lru.push_front(uid);
+    entry.lru_pos = lru.begin();
+    total_size += w_size;
+
+    this->evict(uid);
+    return w;
+}
+
+void WeightsCache::evict(const std::string& keep_uid)
+{
+    if (weights_budget == 0) {
+        return;
+    }
+    // never evict the weights just requested, even if it is over budget alone
+    while (total_size > weights_budget && lru.size() > 1) {
+        std::string uid = lru.back();
+        if (uid == keep_uid) break;
+        lru.pop_back();
+        std::map<std::string, SideEntry>::iterator side = side_entries.find(uid);
+        if (side != side_entries.end()) {
+            std::function<void()> release = side->second.release;
+            total_size -= side->second.size;
+            side_entries.erase(side);
+            release();
+        } else {
+            this->unload(entries[uid]);
+        }
+    }
+}
+
+void WeightsCache::unload(Entry& entry)
+{
+    delete entry.w;
+    delete entry.lag;
+    delete entry.components;
+    entry.w = 0;
+    entry.lag = 0;
+    entry.components = 0;
+    entry.kernel.reset();
+    entry.kernel_order.clear();
+    total_size -= entry.size;
+    entry.size = 0;
+}
+
+size_t EstimateWeightsSize(GeoDaWeight* w)
+{
+    size_t nnz = 0;
+    for (int i = 0; i < w->num_obs; ++i) {
+        nnz += w->GetNbrSize(i);
+    }
+    // gal: neighbor id, weight and the id lookup map node of GalElement;
+    // gwt: one GwtNeighbor (id, weight)
+    size_t per_nbr = w->weight_type == GeoDaWeight::gal_type ? 64 : 16;
+    size_t per_obs = 96;
+    return sizeof(*w) + per_obs * w->num_obs + per_nbr * nnz;
+}
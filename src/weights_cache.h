@@ -0,0 +1,148 @@
+#ifndef JSGEODA_WEIGHTS_CACHE_H
+#define JSGEODA_WEIGHTS_CACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class GeoDaWeight;
+class LagWeights;
+struct KernelSpec;
+struct WeightsComponents;
+struct SpatialOrder;
+
+/**
+ * WeightsParams
+ *
+ * Canonical description of how a weights was created: the weights type and
+ * every parameter, in a fixed order and format. GetUid() hashes it, so two
+ * calls with the same parameters always get the same uid.
+ */
+class WeightsParams {
+public:
+    WeightsParams(const std::string& weights_type, const std::string& map_id);
+
+    WeightsParams& Add(const char* name, double val);
+
+    WeightsParams& Add(const char* name, const std::string& val);
+
+    // e.g. "w_knn_5f0c3e1a2b9d8c7e"
+    std::string GetUid() const;
+
+protected:
+    std::string weights_type;
+    std::string canonical;
+};
+
+/**
+ * WeightsCache
+ *
+ * The weights created for a map, with a memory budget. The weights are kept
+ * in least-recently-used order, and when the estimated size of all weights is
+ * over budget, the least recently used ones are freed.
+ *
+ * A freed entry keeps the function that built it, so its uid stays valid: the
+ * weights are built again on the next Get(). Only Free() forgets a uid.
+ */
+class WeightsCache {
+public:
+    typedef std::function<GeoDaWeight*()> Builder;
+
+    WeightsCache();
+
+    virtual ~WeightsCache();
+
+    // the weights of uid, built again if evicted; 0 if uid is unknown
+    GeoDaWeight* Get(const std::string& uid);
+
+    // the weights of uid, or the result of builder() if uid is unknown
+    GeoDaWeight* GetOrCreate(const std::string& uid, const Builder& builder);
+
+    // the weights of uid prepared for spatial lags in the spatial order so
+    // (empty for file order), in compact layout if compact, and implicit if
+    // implicit and the weights have a kernel (see SetKernelSpec). Created on
+    // first use and freed with the weights; 0 if uid is unknown
+    LagWeights* GetLagWeights(const std::string& uid, const SpatialOrder& so, bool compact, bool implicit = false);
+
+    // the kernel of the kernel weights uid, set by their builder; counted in
+    // the size of the weights and freed with them. Implicit LagWeights share
+    // it instead of a copy, so it is kept in the order of their rows
+    void SetKernelSpec(const std::string& uid, const KernelSpec& kernel);
+
+    // 0 if the weights of uid have no kernel or are not in memory; in the
+    // spatial order of the last implicit LagWeights
+    const KernelSpec* GetKernelSpec(const std::string& uid) const;
+
+    /**
+     * Side data: memory kept beside the weights of the map (e.g. the nearest
+     * neighbor lists shared by the knn weights), counted in the budget. It is
+     * in the least-recently-used order of the weights, and release() is
+     * called when it is evicted; the owner builds it again on next use.
+     */
+    void SetSideData(const std::string& key, size_t size, const std::function<void()>& release);
+
+    // marks the side data of key as used; false if it is not in memory
+    bool UseSideData(const std::string& key);
+
+    // the connected components of the weights of uid, found on first use and
+    // freed with the weights; 0 if uid is unknown
+    const WeightsComponents* GetComponents(const std::string& uid);
+
+    // free the weights of uid and forget it; false if uid is unknown
+    bool Free(const std::string& uid);
+
+    // estimated memory of the weights of uid in bytes (0 if not in memory)
+    size_t GetEntrySize(const std::string& uid) const;
+
+    size_t GetTotalSize() const { return total_size; }
+
+    // memory budget of the weights of each map, in bytes (0 for no limit)
+    static void SetBudget(size_t bytes);
+
+    static size_t GetBudget();
+
+protected:
+    struct Entry {
+        GeoDaWeight* w;
+        LagWeights* lag;
+        WeightsComponents* components;
+        std::shared_ptr<const KernelSpec> kernel;
+        std::vector<int> kernel_order;  // the spatial order of kernel (empty: file order)
+        size_t size;
+        Builder builder;
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    std::map<std::string, Entry> entries;
+
+    struct SideEntry {
+        size_t size;
+        std::function<void()> release;
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    std::map<std::string, SideEntry> side_entries;
+
+    // uids of the entries in memory and keys of the side data, most recently
+    // used first
+    std::list<std::string> lru;
+
+    size_t total_size;
+
+    GeoDaWeight* load(const std::string& uid);
+
+    void evict(const std::string& keep_uid);
+
+    void unload(Entry& entry);
+};
+
+/**
+ * Estimated memory of libgeoda weights in bytes
+ */
+size_t EstimateWeightsSize(GeoDaWeight* w);
+
+#endif //JSGEODA_WEIGHTS_CACHE_H
@@ -0,0 +1,65 @@
+#include <utility>
+
+#include "../libgeoda_src/weights/GeodaWeight.h"
+#include "weights_components.h"
+
+namespace {
+
+    int find_root(std::vector<int>& parent, int i)
+    {
+        // path halving
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+}
+
+WeightsComponents FindComponents(GeoDaWeight* w)
+{
+    WeightsComponents comp;
+    int num_obs = w->num_obs;
+
+    std::vector<int> parent(num_obs), tree_size(num_obs, 1);
+    for (int i = 0; i < num_obs; ++i) parent[i] = i;
+
+    for (int i = 0; i < num_obs; ++i) {
+        const std::vector<long> nbrs = w->GetNeighbors(i);
+        bool is_island = true;
+        for (size_t k = 0; k < nbrs.size(); ++k) {
+            int j = (int)nbrs[k];
+            if (j == i || j < 0 || j >= num_obs) continue;
+            is_island = false;
+            int ri = find_root(parent, i), rj = find_root(parent, j);
+            if (ri == rj) continue;
+            // union by size
+            if (tree_size[ri] < tree_size[rj]) std::swap(ri, rj);
+            parent[rj] = ri;
+            tree_size[ri] += tree_size[rj];
+        }
+        if (is_island) comp.islands.push_back(i);
+    }
+    // a row without neighbors can still be the neighbor of others in
+    // asymmetric weights: it is an island only if its component is itself
+    std::vector<int> islands;
+    for (size_t k = 0; k < comp.islands.size(); ++k) {
+        int i = comp.islands[k];
+        if (tree_size[find_root(parent, i)] == 1) islands.push_back(i);
+    }
+    comp.islands.swap(islands);
+
+    // label the components in the order of their smallest id
+    std::vector<int> root_label(num_obs, -1);
+    comp.labels.resize(num_obs);
+    for (int i = 0; i < num_obs; ++i) {
+        int r = find_root(parent, i);
+        if (root_label[r] < 0) {
+            root_label[r] = comp.num_components++;
+            comp.sizes.push_back(0);
+        }
+        comp.labels[i] = root_label[r];
+        comp.sizes[root_label[r]] += 1;
+    }
+    return comp;
+}
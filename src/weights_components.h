@@ -0,0 +1,38 @@
+#ifndef JSGEODA_WEIGHTS_COMPONENTS_H
+#define JSGEODA_WEIGHTS_COMPONENTS_H
+
+#include <vector>
+
+class GeoDaWeight;
+
+/**
+ * WeightsComponents
+ *
+ * The connected components of the graph of spatial weights, with every
+ * neighbor relation taken as undirected (so asymmetric weights, e.g. knn, are
+ * handled as well). Components are labeled 0, 1, ... in the order of their
+ * smallest observation id.
+ *
+ * An island is an observation that has no neighbor and is no other
+ * observation's neighbor (the diagonal does not count): a component of size 1.
+ */
+struct WeightsComponents {
+    int num_components;
+    std::vector<int> labels;  // component of each observation
+    std::vector<int> sizes;   // number of observations of each component
+    std::vector<int> islands; // ids of the islands, ascending
+
+    WeightsComponents() : num_components(0) {}
+
+    bool IsConnected() const { return num_components <= 1; }
+
+    bool HasIslands() const { return !islands.empty(); }
+};
+
+/**
+ * Find the connected components of the weights with a union-find pass over
+ * all neighbor pairs: O(n + nnz) (up to the inverse Ackermann factor).
+ */
+WeightsComponents FindComponents(GeoDaWeight* w);
+
+#endif //JSGEODA_WEIGHTS_COMPONENTS_H
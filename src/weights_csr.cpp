@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+
+#include "../libgeoda_src/weights/GalWeight.h"
+#include "../libgeoda_src/weights/GwtWeight.h"
+#include "parallel.h"
+#include "weights_csr.h"
+
+WeightsCSR CSRFromPairs(int num_obs, const std::vector<std::vector<std::pair<int, int> > >& pair_buckets,
+                        int n_threads)
+{
+    return CSRFromWeightedPairs(num_obs, pair_buckets, std::vector<std::vector<double> >(), n_threads);
+}
+
+WeightsCSR CSRFromWeightedPairs(int num_obs, const std::vector<std::vector<std::pair<int, int> > >& pair_buckets,
+                                const std::vector<std::vector<double> >& weight_buckets, int n_threads)
+{
+    WeightsCSR csr;
+    csr.num_obs = num_obs;
+    csr.is_symmetric = true;
+    csr.offsets.resize(num_obs + 1, 0);
+    bool has_weights = !weight_buckets.empty();
+
+    // count: each undirected pair contributes one neighbor to both ends
+    std::vector<size_t> degree(num_obs, 0);
+    for (size_t b = 0; b < pair_buckets.size(); ++b) {
+        const std::vector<std::pair<int, int> >& pairs = pair_buckets[b];
+        for (size_t p = 0; p < pairs.size(); ++p) {
+            degree[pairs[p].first] += 1;
+            degree[pairs[p].second] += 1;
+        }
+    }
+    for (int i = 0; i < num_obs; ++i) {
+        csr.offsets[i + 1] = csr.offsets[i] + degree[i];
+    }
+
+    // fill
+    csr.nbrs.resize(csr.offsets[num_obs]);
+    if (has_weights) csr.weights.resize(csr.offsets[num_obs]);
+    std::vector<size_t> pos(csr.offsets.begin(), csr.offsets.end() - 1);
+    for (size_t b = 0; b < pair_buckets.size(); ++b) {
+        const std::vector<std::pair<int, int> >& pairs = pair_buckets[b];
+        for (size_t p = 0; p < pairs.size(); ++p) {
+            int i = pairs[p].first, j = pairs[p].second;
+            if (has_weights) {
+                csr.weights[pos[i]] = weight_buckets[b][p];
+                csr.weights[pos[j]] = weight_buckets[b][p];
+            }
+            csr.nbrs[pos[i]++] = j;
+            csr.nbrs[pos[j]++] = i;
+        }
+    }
+
+    // sort and remove duplicated neighbors of each row (summing their weights)
+    gda_parallel_for(num_obs, n_threads, [&](size_t start, size_t end, int) {
+        std::vector<std::pair<long, double> > row;
+        for (size_t i = start; i < end; ++i) {
+            std::vector<long>::iterator row_begin = csr.nbrs.begin() + csr.offsets[i];
+            std::vector<long>::iterator row_end = csr.nbrs.begin() + csr.offsets[i + 1];
+            if (!has_weights) {
+                std::sort(row_begin, row_end);
+                degree[i] = std::unique(row_begin, row_end) - row_begin;
+                continue;
+            }
+            row.clear();
+            for (size_t k = csr.offsets[i]; k < csr.offsets[i + 1]; ++k) {
+                row.push_back(std::make_pair(csr.nbrs[k], csr.weights[k]));
+            }
+            std::sort(row.begin(), row.end());
+            size_t nn = 0;
+            for (size_t k = 0; k < row.size(); ++k) {
+                if (nn > 0 && row[nn - 1].first == row[k].first) {
+                    row[nn - 1].second += row[k].second;
+                } else {
+                    row[nn++] = row[k];
+                }
+            }
+            for (size_t k = 0; k < nn; ++k) {
+                csr.nbrs[csr.offsets[i] + k] = row[k].first;
+                csr.weights[csr.offsets[i] + k] = row[k].second;
+            }
+            degree[i] = nn;
+        }
+    });
+
+    // compact: rows only shrink, so moving them forward in order is safe
+    size_t nnz = 0;
+    for (int i = 0; i < num_obs; ++i) {
+        size_t old_start = csr.offsets[i];
+        csr.offsets[i] = nnz;
+        if (old_start != nnz) {
+            std::copy(csr.nbrs.begin() + old_start, csr.nbrs.begin() + old_start + degree[i],
+                      csr.nbrs.begin() + nnz);
+            if (has_weights) {
+                std::copy(csr.weights.begin() + old_start, csr.weights.begin() + old_start + degree[i],
+                          csr.weights.begin() + nnz);
+            }
+        }
+        nnz += degree[i];
+    }
+    csr.offsets[num_obs] = nnz;
+    csr.nbrs.resize(nnz);
+    if (has_weights) csr.weights.resize(nnz);
+
+    return csr;
+}
+
+void CSRSortRows(WeightsCSR& csr, int n_threads)
+{
+    bool has_weights = !csr.weights.empty();
+    gda_parallel_for(csr.num_obs, n_threads, [&](size_t start, size_t end, int) {
+        std::vector<std::pair<long, double> > row;
+        for (size_t i = start; i < end; ++i) {
+            size_t row_start = csr.offsets[i], row_end = csr.offsets[i + 1];
+            if (!has_weights) {
+                std::sort(csr.nbrs.begin() + row_start, csr.nbrs.begin() + row_end);
+                continue;
+            }
+            row.clear();
+            for (size_t k = row_start; k < row_end; ++k) {
+                row.push_back(std::make_pair(csr.nbrs[k], csr.weights[k]));
+            }
+            std::sort(row.begin(), row.end());
+            for (size_t k = row_start; k < row_end; ++k) {
+                csr.nbrs[k] = row[k - row_start].first;
+                csr.weights[k] = row[k - row_start].second;
+            }
+        }
+    });
+}
+
+GalWeight* CSRToGalWeight(const WeightsCSR& csr)
+{
+    GalWeight* w = new GalWeight;
+    w->num_obs = csr.num_obs;
+    w->is_symmetric = csr.is_symmetric;
+    w->symmetry_checked = true;
+    w->gal = new GalElement[csr.num_obs];
+    for (int i = 0; i < csr.num_obs; ++i) {
+        size_t start = csr.offsets[i];
+        size_t nn = csr.GetNbrSize(i);
+        w->gal[i].SetSizeNbrs(nn);
+        for (size_t k = 0; k < nn; ++k) {
+            w->gal[i].SetNbr(k, csr.nbrs[start + k]);
+        }
+    }
+    w->GetNbrStats();
+    return w;
+}
+
+GwtWeight* CSRToGwtWeight(const WeightsCSR& csr)
+{
+    GwtWeight* w = new GwtWeight;
+    w->num_obs = csr.num_obs;
+    w->is_symmetric = csr.is_symmetric;
+    w->symmetry_checked = true;
+    w->gwt = new GwtElement[csr.num_obs];
+    for (int i = 0; i < csr.num_obs; ++i) {
+        size_t start = csr.offsets[i];
+        size_t nn = csr.GetNbrSize(i);
+        w->gwt[i].alloc((int)nn);
+        for (size_t k = 0; k < nn; ++k) {
+            double wij = csr.IsBinary() ? 1.0 : csr.weights[start + k];
+            w->gwt[i].Push(GwtNeighbor(csr.nbrs[start + k], wij));
+        }
+    }
+    w->GetNbrStats();
+    return w;
+}
+
+void CSRDistancesToWeights(WeightsCSR& csr, double power, bool is_inverse)
+{
+    for (size_t j = 0; j < csr.weights.size(); ++j) {
+        if (!is_inverse) {
+            csr.weights[j] = 1.0;
+        } else {
+            double d = csr.weights[j];
+            csr.weights[j] = d > 0 ? std::pow(d, -power) : 0;
+        }
+    }
+}
+
+GeoDaWeight* CSRToGeoDaWeight(const WeightsCSR& csr)
+{
+    if (csr.IsBinary()) {
+        return CSRToGalWeight(csr);
+    }
+    return CSRToGwtWeight(csr);
+}
+
+WeightsCSR GeoDaWeightToCSR(GeoDaWeight* w)
+{
+    WeightsCSR csr;
+    csr.num_obs = w->num_obs;
+    csr.is_symmetric = w->is_symmetric;
+    csr.offsets.resize(csr.num_obs + 1, 0);
+    bool is_binary = w->weight_type == GeoDaWeight::gal_type;
+    for (int i = 0; i < csr.num_obs; ++i) {
+        const std::vector<long> nbrs = w->GetNeighbors(i);
+        csr.nbrs.insert(csr.nbrs.end(), nbrs.begin(), nbrs.end());
+        if (!is_binary) {
+            const std::vector<double> wvals = w->GetNeighborWeights(i);
+            csr.weights.insert(csr.weights.end(), wvals.begin(), wvals.end());
+        }
+        csr.offsets[i + 1] = csr.nbrs.size();
+    }
+    return csr;
+}
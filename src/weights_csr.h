@@ -0,0 +1,84 @@
+#ifndef JSGEODA_WEIGHTS_CSR_H
+#define JSGEODA_WEIGHTS_CSR_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+class GeoDaWeight;
+class GalWeight;
+class GwtWeight;
+
+/**
+ * WeightsCSR
+ *
+ * Compressed sparse row layout of spatial weights. The weights builders in
+ * wasmgeoda write neighbors directly into this layout, and convert it to
+ * GalWeight/GwtWeight only at the end, so the libgeoda functions (LISA,
+ * clustering) can still consume the result.
+ *
+ * The neighbors of observation i are nbrs[offsets[i] .. offsets[i+1]).
+ * weights is empty for binary (gal) weights.
+ */
+struct WeightsCSR {
+    int num_obs;
+    bool is_symmetric;
+    std::vector<size_t> offsets;
+    std::vector<long> nbrs;
+    std::vector<double> weights;
+
+    WeightsCSR() : num_obs(0), is_symmetric(false) {}
+
+    size_t GetNbrSize(int obs_idx) const { return offsets[obs_idx + 1] - offsets[obs_idx]; }
+
+    size_t GetNumNonZeros() const { return nbrs.size(); }
+
+    bool IsBinary() const { return weights.empty(); }
+};
+
+/**
+ * Build a symmetric binary CSR from undirected pairs (i, j), i != j. The pairs
+ * can be spread over several buckets (e.g. one bucket per thread or per hash
+ * shard) and may contain duplicates; the neighbors of each row are sorted and
+ * de-duplicated.
+ */
+WeightsCSR CSRFromPairs(int num_obs, const std::vector<std::vector<std::pair<int, int> > >& pair_buckets,
+                        int n_threads);
+
+/**
+ * Same as CSRFromPairs(), with a weight for each pair (weight_buckets[b][p] is
+ * the weight of pair_buckets[b][p]). The weights of duplicated pairs are
+ * summed.
+ */
+WeightsCSR CSRFromWeightedPairs(int num_obs, const std::vector<std::vector<std::pair<int, int> > >& pair_buckets,
+                                const std::vector<std::vector<double> >& weight_buckets, int n_threads);
+
+/**
+ * Sort the neighbors of each row (and their weights) by neighbor id
+ */
+void CSRSortRows(WeightsCSR& csr, int n_threads);
+
+/**
+ * Turn the neighbor distances stored in csr.weights into weights: 1 for
+ * every neighbor, or the inverse distance 1/d^power if is_inverse (0 for
+ * coincident points)
+ */
+void CSRDistancesToWeights(WeightsCSR& csr, double power, bool is_inverse);
+
+/**
+ * Convert CSR weights to libgeoda weights: GalWeight if binary, otherwise
+ * GwtWeight. The neighbor statistics (min/max/mean/median, sparsity) are
+ * computed before returning.
+ */
+GeoDaWeight* CSRToGeoDaWeight(const WeightsCSR& csr);
+
+GalWeight* CSRToGalWeight(const WeightsCSR& csr);
+
+GwtWeight* CSRToGwtWeight(const WeightsCSR& csr);
+
+/**
+ * Read the neighbors (and weights for gwt type) of libgeoda weights into CSR
+ */
+WeightsCSR GeoDaWeightToCSR(GeoDaWeight* w);
+
+#endif //JSGEODA_WEIGHTS_CSR_H
@@ -2,7 +2,10 @@
 // Created by Xun Li on 2019-06-06.
 //
 
+#include <algorithm>
 #include <vector>
+#include <ctime>
+#include <iostream>
 #include <limits.h>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
@@ -10,6 +13,11 @@
 #include "../src/gda_weights.h"
 #include "../src/gda_sa.h"
 #include "../src/geojson.h"
+#include "../src/lisa_engine.h"
+#include "../src/lisa_kernels.h"
+#include "../src/philox.h"
+#include "../src/spatial_lag.h"
+#include "../src/weights_csr.h"
 #include "../src/weights/GeodaWeight.h"
 #include "../src/sa/UniLocalMoran.h"
 #include "../src/sa/UniGeary.h"
@@ -156,4 +164,450 @@ namespace {
         EXPECT_DOUBLE_EQ(pvals[1], 0.123);
         EXPECT_DOUBLE_EQ(pvals[2], 0.001);
     }
-}
\ No newline at end of file
+
+    // the statistics, lags and neighbor counts of the engine are the ones of
+    // libgeoda; the pseudo p-values come from another random generator, so
+    // with the same seed they are only close. The cluster of a significant
+    // observation does not depend on the generator: it is the same wherever
+    // libgeoda reports one, and so is the reported cluster wherever both
+    // p-values are on the same side of the cutoff
+    void expect_same_as_libgeoda(LISA* ref, const LisaOutput& lisa) {
+        std::vector<double> ref_vals = ref->GetLISAValues();
+        std::vector<double> ref_lags = ref->GetSpatialLagValues();
+        std::vector<double> ref_pvals = ref->GetLocalSignificanceValues();
+        std::vector<int> ref_nn = ref->GetNumNeighbors();
+        std::vector<int> ref_clusters = ref->GetClusterIndicators();
+        double cutoff = LisaParams().significance_cutoff;
+        ASSERT_THAT(lisa.lisa_vals.size(), ref_vals.size());
+        int num_compared = 0;
+        for (size_t i=0; i<ref_vals.size(); ++i) {
+            EXPECT_NEAR(lisa.lisa_vals[i], ref_vals[i], 1e-12);
+            EXPECT_NEAR(lisa.lags[i], ref_lags[i], 1e-12);
+            EXPECT_THAT(lisa.nn[i], ref_nn[i]);
+            EXPECT_NEAR(lisa.sig_local[i], ref_pvals[i], 0.1);
+            if (ref_clusters[i] != 0) EXPECT_EQ(lisa.sig_clusters[i], ref_clusters[i]) << "observation " << i;
+            if ((lisa.sig_local[i] <= cutoff) == (ref_pvals[i] <= cutoff)) {
+                EXPECT_EQ(lisa.clusters[i], ref_clusters[i]) << "observation " << i;
+                ++num_compared;
+            }
+        }
+        // only a few observations are near the cutoff
+        EXPECT_GT(num_compared, (int)ref_vals.size() * 9 / 10);
+    }
+
+    TEST(LOCALSA_TEST, LISA_ENGINE_SAME_AS_LIBGEODA) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        GeoDaWeight* w = gda_queen_weights(&gda);
+        LagWeights lw(w);
+        std::vector<double> data = gda.GetNumericCol("Crm_prp");
+        std::vector<bool> undefs;
+        LisaParams params;
+
+        UniLocalMoran* moran = gda_localmoran(w, data);
+        LisaOutput lisa = LocalMoran(lw, data, undefs, params);
+        expect_same_as_libgeoda(moran, lisa);
+        delete moran;
+        EXPECT_DOUBLE_EQ(lisa.lisa_vals[0], 0.015431978309803657);
+        EXPECT_DOUBLE_EQ(lisa.lisa_vals[2], 0.021295296214118884);
+        EXPECT_THAT(lisa.clusters[2], 1);
+
+        UniG* localg = gda_localg(w, data);
+        lisa = LocalG(lw, data, undefs, false, params);
+        expect_same_as_libgeoda(localg, lisa);
+        delete localg;
+        EXPECT_DOUBLE_EQ(lisa.lisa_vals[0], 0.012077920687925825);
+        EXPECT_THAT(lisa.clusters[2], 1);
+
+        UniGstar* localgstar = gda_localgstar(w, data);
+        lisa = LocalG(lw, data, undefs, true, params);
+        expect_same_as_libgeoda(localgstar, lisa);
+        delete localgstar;
+        EXPECT_DOUBLE_EQ(lisa.lisa_vals[0], 0.014177043620524426);
+        EXPECT_THAT(lisa.clusters[2], 1);
+
+        UniGeary* geary = gda_geary(w, data);
+        lisa = LocalGeary(lw, data, undefs, params);
+        expect_same_as_libgeoda(geary, lisa);
+        delete geary;
+        EXPECT_DOUBLE_EQ(lisa.lisa_vals[0], 7.3980833011783602);
+        EXPECT_THAT(lisa.clusters[1], 2);
+        delete w;
+
+        GdaGeojson columbus("../data/Columbus.geojson");
+        GeoDaWeight* w_columbus = gda_queen_weights(&columbus);
+        LagWeights lw_columbus(w_columbus);
+        std::vector<double> nsa = columbus.GetNumericCol("nsa");
+        UniJoinCount* jc = gda_joincount(w_columbus, nsa);
+        lisa = LocalJoinCount(lw_columbus, nsa, undefs, params);
+        expect_same_as_libgeoda(jc, lisa);
+        delete jc;
+        EXPECT_DOUBLE_EQ(lisa.lisa_vals[2], 4);
+        EXPECT_THAT(lisa.nn[2], 4);
+        delete w_columbus;
+    }
+
+    TEST(LOCALSA_TEST, LISA_THREADS_SAME_RESULTS) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        std::vector<double> data = gda.GetNumericCol("Crm_prp");
+        std::vector<bool> undefs(data.size(), false);
+
+        LisaParams params;
+        params.n_threads = 1;
+        LisaOutput lisa = LocalMoran(*gda.GetLagWeights(w_uid), data, undefs, params);
+
+        // same pseudo p-values with more threads and in spatial order
+        params.n_threads = 4;
+        gda.SetSpatialOrder(true);
+        LisaOutput lisa_mt = LocalMoran(*gda.GetLagWeights(w_uid), data, undefs, params);
+        for (size_t i=0; i<data.size(); ++i) {
+            EXPECT_NEAR(lisa.lisa_vals[i], lisa_mt.lisa_vals[i], 1e-12);
+            EXPECT_DOUBLE_EQ(lisa.sig_local[i], lisa_mt.sig_local[i]);
+            EXPECT_THAT(lisa.clusters[i], lisa_mt.clusters[i]);
+        }
+    }
+
+    TEST(LOCALSA_TEST, PHILOX_KNOWN_ANSWERS) {
+        // Random123 known-answer vectors of Philox4x32-10
+        Philox4x32::Block b = Philox4x32(0).Generate(0, 0, 0, 0);
+        EXPECT_THAT(b.v[0], 0x6627e8d5U);
+        EXPECT_THAT(b.v[3], 0x9b00dbd8U);
+
+        Philox4x32 philox(0xa4093822ULL | (0x299f31d0ULL << 32));
+        b = philox.Generate(0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344);
+        EXPECT_THAT(b.v[0], 0xd16cfe09U);
+        EXPECT_THAT(b.v[1], 0x94fdccebU);
+        EXPECT_THAT(b.v[2], 0x5001e420U);
+        EXPECT_THAT(b.v[3], 0x24126ea1U);
+    }
+
+    TEST(LOCALSA_TEST, PERMUTATION_TABLE_REUSED) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        LisaParams params;
+        params.permutation_method = "lookup";
+
+        ClearPermutationTables();
+        LisaOutput crm = LocalMoran(*gda.GetLagWeights(w_uid), gda.GetNumericCol("Crm_prp"), std::vector<bool>(), params);
+        std::shared_ptr<const PermutationTable> table = GetPermutationTable(84, 1, 999, params.last_seed_used, 1);
+        LocalMoran(*gda.GetLagWeights(w_uid), gda.GetNumericCol("Litercy"), std::vector<bool>(), params);
+        // the second variable (and a narrower request) uses the same table
+        EXPECT_EQ(table, GetPermutationTable(84, 1, 999, params.last_seed_used, 1));
+
+        params.significance_cutoff = 0.01;
+        LisaOutput crm_01 = LocalMoran(*gda.GetLagWeights(w_uid), gda.GetNumericCol("Crm_prp"), std::vector<bool>(), params);
+        EXPECT_EQ(crm.sig_local, crm_01.sig_local);
+    }
+
+    TEST(LOCALSA_TEST, LISA_BATCH_SAME_AS_SINGLE) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        std::vector<std::vector<double> > data;
+        data.push_back(gda.GetNumericCol("Crm_prp"));
+        data.push_back(gda.GetNumericCol("Litercy"));
+        data.push_back(gda.GetNumericCol("Donatns"));
+        std::vector<std::vector<bool> > undefs(3, std::vector<bool>(data[0].size(), false));
+        undefs[2][0] = true;
+
+        LisaParams params;
+        std::vector<LisaOutput> batch = LocalMoranBatch(*gda.GetLagWeights(w_uid), data, undefs, params);
+        for (size_t v=0; v<data.size(); ++v) {
+            LisaOutput lisa = LocalMoran(*gda.GetLagWeights(w_uid), data[v], undefs[v], params);
+            EXPECT_EQ(lisa.lisa_vals, batch[v].lisa_vals);
+            EXPECT_EQ(lisa.sig_local, batch[v].sig_local);
+            EXPECT_EQ(lisa.clusters, batch[v].clusters);
+        }
+    }
+
+    TEST(LOCALSA_TEST, LISA_KERNELS_SAME_RESULTS) {
+        // wide rows, where the SIMD gather kernels are used: the same bits as
+        // the scalar kernels
+        GdaGeojson gda("../data/natregimes.geojson");
+        std::string w_uid = gda.CreateKnnWeights(64, 1.0, false, false, false)->uid;
+        std::vector<double> data = gda.GetNumericCol("HR90");
+        LisaParams params;
+        params.permutations = 99;
+
+        LisaKernelPath best = GetLisaKernelPath();
+        std::vector<LisaOutput> lisa(2);
+        for (int use_simd=0; use_simd<2; ++use_simd) {
+            SetLisaKernelPath(use_simd ? best : LISA_KERNEL_SCALAR);
+            lisa[use_simd] = LocalGeary(*gda.GetLagWeights(w_uid), data, std::vector<bool>(), params);
+        }
+        SetLisaKernelPath(best);
+        EXPECT_EQ(lisa[0].lisa_vals, lisa[1].lisa_vals);
+        EXPECT_EQ(lisa[0].sig_local, lisa[1].sig_local);
+    }
+
+    // timing only: run with --gtest_also_run_disabled_tests
+    TEST(LOCALSA_TEST, DISABLED_LISA_KERNELS_BENCHMARK) {
+        GdaGeojson gda("../data/natregimes.geojson");
+        std::string w_uid = gda.CreateKnnWeights(64, 1.0, false, false, false)->uid;
+        std::vector<double> data = gda.GetNumericCol("HR90");
+        LisaParams params;
+
+        LisaKernelPath best = GetLisaKernelPath();
+        for (int use_simd=0; use_simd<2; ++use_simd) {
+            SetLisaKernelPath(use_simd ? best : LISA_KERNEL_SCALAR);
+            clock_t start = clock();
+            LocalGeary(*gda.GetLagWeights(w_uid), data, std::vector<bool>(), params);
+            std::cout << (use_simd ? "simd kernels: " : "scalar kernels: ")
+                      << double(clock() - start) / CLOCKS_PER_SEC << "s" << std::endl;
+        }
+        SetLisaKernelPath(best);
+    }
+
+    TEST(LOCALSA_TEST, LISA_EARLY_STOPPING) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        std::vector<double> data = gda.GetNumericCol("Crm_prp");
+        LisaParams params;
+        params.permutations = 9999;
+        LisaOutput lisa = LocalMoran(*gda.GetLagWeights(w_uid), data, std::vector<bool>(), params);
+
+        params.early_stopping = true;
+        LisaOutput lisa_es = LocalMoran(*gda.GetLagWeights(w_uid), data, std::vector<bool>(), params);
+        int total_used = 0;
+        for (size_t i=0; i<data.size(); ++i) {
+            // same clusters; the significant observations ran all permutations
+            EXPECT_THAT(lisa.clusters[i], lisa_es.clusters[i]);
+            if (lisa.sig_local[i] <= params.significance_cutoff) {
+                EXPECT_THAT(lisa_es.perms_used[i], 9999);
+                EXPECT_DOUBLE_EQ(lisa.sig_local[i], lisa_es.sig_local[i]);
+            } else {
+                EXPECT_GT(lisa_es.sig_local[i], params.significance_cutoff);
+            }
+            total_used += lisa_es.perms_used[i];
+        }
+        EXPECT_LT(total_used, 9999 * (int)data.size());
+    }
+
+    TEST(LOCALSA_TEST, LISA_ANALYTIC) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        LagWeights& w = *gda.GetLagWeights(w_uid);
+        std::vector<double> data = gda.GetNumericCol("Crm_prp");
+        LisaParams params, params_a;
+        params.permutations = 9999;
+        params_a.permutation_method = "analytic";
+        double cutoff = params.significance_cutoff;
+
+        std::vector<LisaOutput> lisa = {LocalMoran(w, data, std::vector<bool>(), params),
+                                        LocalG(w, data, std::vector<bool>(), false, params),
+                                        LocalG(w, data, std::vector<bool>(), true, params)};
+        std::vector<LisaOutput> lisa_a = {LocalMoran(w, data, std::vector<bool>(), params_a),
+                                          LocalG(w, data, std::vector<bool>(), false, params_a),
+                                          LocalG(w, data, std::vector<bool>(), true, params_a)};
+        for (size_t k=0; k<lisa.size(); ++k) {
+            for (size_t i=0; i<data.size(); ++i) {
+                double p = lisa[k].sig_local[i], p_a = lisa_a[k].sig_local[i];
+                EXPECT_DOUBLE_EQ(lisa[k].lisa_vals[i], lisa_a[k].lisa_vals[i]);
+                EXPECT_THAT(lisa_a[k].perms_used[i], 0);
+                // the normal approximation of a statistic of 2 to 8 neighbors
+                // is off by a few hundredths in the tail (the 9999 permutations
+                // are within 0.003): the same significance away from the
+                // cutoff, and close p-values where they matter
+                if (p < cutoff / 2 || p > cutoff * 2) {
+                    EXPECT_EQ(p <= cutoff, p_a <= cutoff) << "observation " << i;
+                    EXPECT_EQ(lisa[k].clusters[i], lisa_a[k].clusters[i]) << "observation " << i;
+                }
+                if (std::min(p, p_a) < 0.1) EXPECT_NEAR(p, p_a, 0.04) << "observation " << i;
+            }
+        }
+    }
+
+    TEST(LOCALSA_TEST, LISA_RECATEGORIZE) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        std::vector<double> data = gda.GetNumericCol("Crm_prp");
+        LisaParams params;
+        LisaOutput lisa = LocalMoran(*gda.GetLagWeights(w_uid), data, std::vector<bool>(), params);
+        params.significance_cutoff = 0.01;
+        LisaOutput lisa_01 = LocalMoran(*gda.GetLagWeights(w_uid), data, std::vector<bool>(), params);
+
+        // same clusters as a run at 0.01
+        LisaOutput recat = lisa;
+        Recategorize(recat, 0.01, "none");
+        EXPECT_THAT(recat.clusters, lisa_01.clusters);
+        EXPECT_THAT(recat.sig_cats, lisa_01.sig_cats);
+
+        // the significant observations of bonferroni and fdr are significant
+        // without correction
+        for (const char* correction : {"bonferroni", "fdr"}) {
+            recat = lisa;
+            Recategorize(recat, 0.05, correction);
+            for (size_t i=0; i<data.size(); ++i) {
+                if (recat.clusters[i] != 0) EXPECT_THAT(recat.clusters[i], lisa.clusters[i]);
+            }
+        }
+    }
+
+    TEST(LOCALSA_TEST, LISA_SESSION) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        LagWeights& w = *gda.GetLagWeights(w_uid);
+        std::vector<double> data = gda.GetNumericCol("Crm_prp");
+        LisaParams params;
+
+        // max_stale 1: the permutations of the observations not affected by
+        // the edits are kept
+        LocalMoranSession session(w, data, std::vector<bool>(), params, 1.0);
+        std::vector<int> indices = {3, 40};
+        std::vector<double> values = {data[3] * 2, data[40] / 2};
+        LisaOutput lisa = session.Update(w, indices, values);
+        EXPECT_LT(session.GetNumPermuted(), (int)data.size());
+
+        data[3] *= 2;
+        data[40] /= 2;
+        LisaOutput lisa_new = LocalMoran(w, data, std::vector<bool>(), params);
+        EXPECT_THAT(lisa.lisa_vals, lisa_new.lisa_vals);
+        EXPECT_THAT(lisa.lags, lisa_new.lags);
+        // the permuted observations are the ones of a fresh run; the kept
+        // counts of the others are stale
+        const std::vector<int>& permuted = session.GetPermuted();
+        EXPECT_TRUE(std::find(permuted.begin(), permuted.end(), 3) != permuted.end());
+        EXPECT_TRUE(std::find(permuted.begin(), permuted.end(), 40) != permuted.end());
+        for (size_t k=0; k<permuted.size(); ++k) {
+            int i = permuted[k];
+            EXPECT_THAT(lisa.perm_counts[i], lisa_new.perm_counts[i]);
+            EXPECT_DOUBLE_EQ(lisa.sig_local[i], lisa_new.sig_local[i]);
+            EXPECT_THAT(lisa.clusters[i], lisa_new.clusters[i]);
+        }
+
+        // max_stale 0: every update runs all the permutations
+        LocalMoranSession session_full(w, gda.GetNumericCol("Crm_prp"), std::vector<bool>(), params, 0);
+        lisa = session_full.Update(w, indices, {data[3], data[40]});
+        EXPECT_THAT(session_full.GetNumPermuted(), (int)data.size());
+        EXPECT_THAT(lisa.lisa_vals, lisa_new.lisa_vals);
+        EXPECT_THAT(lisa.perm_counts, lisa_new.perm_counts);
+        EXPECT_THAT(lisa.sig_local, lisa_new.sig_local);
+        EXPECT_THAT(lisa.clusters, lisa_new.clusters);
+    }
+
+    TEST(LOCALSA_TEST, LISA_JOINCOUNT_MASK) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        LagWeights& w = *gda.GetLagWeights(w_uid);
+        std::vector<double> crm = gda.GetNumericCol("Crm_prp");
+        std::vector<double> lit = gda.GetNumericCol("Litercy");
+        std::vector<double> x(crm.size()), y(crm.size()), both(crm.size());
+        for (size_t i=0; i<crm.size(); ++i) {
+            x[i] = crm[i] > 20000 ? 1 : 0;
+            y[i] = lit[i] > 40 ? 1 : 0;
+            both[i] = x[i] * y[i];
+        }
+        std::vector<bool> undefs(crm.size(), false);
+        undefs[10] = true;
+        LisaParams params;
+        LisaOutput lisa = LocalJoinCount(w, both, undefs, params);
+
+        // the packed co-location of x and y
+        std::vector<BitMask> masks = {PackMask(x), PackMask(y)};
+        std::vector<BitMask> undef_masks = {PackMask(undefs)};
+        LisaOutput lisa_mask = LocalMultiJoinCount(w, masks, undef_masks, params);
+        EXPECT_THAT(lisa_mask.lisa_vals, lisa.lisa_vals);
+        EXPECT_THAT(lisa_mask.sig_local, lisa.sig_local);
+        EXPECT_THAT(lisa_mask.clusters, lisa.clusters);
+        EXPECT_THAT(lisa_mask.clusters[10], 2);
+    }
+
+    TEST(LOCALSA_TEST, LISA_MORE_NEIGHBORS_THAN_POOL) {
+        // obs 0 lists 1 and 2 twice: 4 neighbors, but only 2 other defined
+        // observations to draw them from, so it is not permuted
+        WeightsCSR csr;
+        csr.num_obs = 4;
+        csr.offsets = {0, 4, 6, 8, 10};
+        csr.nbrs = {1, 2, 1, 2, 0, 3, 0, 3, 1, 2};
+        GeoDaWeight* w = CSRToGeoDaWeight(csr);
+        LagWeights lw(w);
+        std::vector<double> data = {1, 5, 6, 2};
+        std::vector<bool> undefs = {false, false, false, true};
+        LisaParams params;
+
+        std::vector<LisaOutput> lisa = {LocalMoran(lw, data, undefs, params), LocalGeary(lw, data, undefs, params),
+                                        LocalG(lw, data, undefs, false, params)};
+        for (size_t k=0; k<lisa.size(); ++k) {
+            EXPECT_THAT(lisa[k].nn[0], 4);
+            EXPECT_DOUBLE_EQ(lisa[k].sig_local[0], 1.0);
+            EXPECT_THAT(lisa[k].clusters[0], 0);
+            EXPECT_THAT(lisa[k].perms_used[0], 0);
+        }
+        delete w;
+    }
+
+    TEST(LOCALSA_TEST, LISA_BIVARIATE_JOINCOUNT) {
+        // a ring of 6: x and y never co-occur, so the join count of x_i with
+        // the y of its neighbors
+        WeightsCSR csr;
+        csr.num_obs = 6;
+        csr.offsets = {0, 2, 4, 6, 8, 10, 12};
+        csr.nbrs = {5, 1, 0, 2, 1, 3, 2, 4, 3, 5, 4, 0};
+        GeoDaWeight* w = CSRToGeoDaWeight(csr);
+        LagWeights lw(w);
+        std::vector<double> x = {1, 0, 1, 0, 0, 0};
+        std::vector<double> y = {0, 1, 0, 1, 1, 0};
+        std::vector<BitMask> masks = {PackMask(x), PackMask(y)};
+        LisaParams params;
+        LisaOutput lisa = LocalMultiJoinCount(lw, masks, std::vector<BitMask>(), params);
+        std::vector<double> joins = {1, 0, 2, 0, 0, 0};
+        EXPECT_THAT(lisa.lisa_vals, joins);
+
+        LisaOutput bi = LocalBivariateJoinCount(lw, masks[0], masks[1], BitMask(), params);
+        EXPECT_THAT(bi.lisa_vals, lisa.lisa_vals);
+        EXPECT_THAT(bi.sig_local, lisa.sig_local);
+        EXPECT_DOUBLE_EQ(lisa.sig_local[1], 1.0);
+        delete w;
+    }
+
+    TEST(LOCALSA_TEST, LISA_MULTIJOINCOUNT_MASK_BIVARIATE) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        GeoDaWeight* w = gda_queen_weights(&gda);
+        LagWeights lw(w);
+        std::vector<double> crm = gda.GetNumericCol("Crm_prp");
+        std::vector<std::vector<double> > data(2, std::vector<double>(crm.size()));
+        for (size_t i=0; i<crm.size(); ++i) {
+            data[0][i] = crm[i] > 20000 ? 1 : 0;
+            data[1][i] = crm[i] < 10000 ? 1 : 0;
+        }
+        std::vector<std::vector<bool> > undefs(2, std::vector<bool>(crm.size(), false));
+
+        // the packed masks never co-occur: same join counts as libgeoda's
+        // bivariate join count
+        std::vector<BitMask> masks = {PackMask(data[0]), PackMask(data[1])};
+        LisaParams params;
+        LisaOutput lisa = LocalMultiJoinCount(lw, masks, std::vector<BitMask>(), params);
+        LISA* ref = gda_localmultijoincount(w, data, undefs, 0.05, 1, 999, "complete", 123456789);
+        std::vector<double> ref_vals = ref->GetLISAValues();
+        std::vector<int> ref_nn = ref->GetNumNeighbors();
+        ASSERT_THAT(lisa.lisa_vals.size(), ref_vals.size());
+        double joins = 0;
+        for (size_t i=0; i<ref_vals.size(); ++i) {
+            EXPECT_DOUBLE_EQ(lisa.lisa_vals[i], ref_vals[i]);
+            EXPECT_THAT(lisa.nn[i], ref_nn[i]);
+            joins += lisa.lisa_vals[i];
+        }
+        EXPECT_GT(joins, 0);
+        delete ref;
+        delete w;
+    }
+
+    TEST(LOCALSA_TEST, LISA_SESSION_SPATIAL_ORDER) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        std::vector<double> data = gda.GetNumericCol("Crm_prp");
+        LisaParams params;
+        LocalMoranSession session(*gda.GetLagWeights(w_uid), data, std::vector<bool>(), params, 1.0);
+
+        // the weights now in spatial order: nothing was edited, so nothing
+        // is permuted again
+        gda.SetSpatialOrder(true);
+        LagWeights& w = *gda.GetLagWeights(w_uid);
+        LisaOutput lisa = session.Update(w, std::vector<int>(), std::vector<double>());
+        EXPECT_THAT(session.GetNumPermuted(), 0);
+        LisaOutput lisa_new = LocalMoran(w, data, std::vector<bool>(), params);
+        for (size_t i=0; i<data.size(); ++i) {
+            EXPECT_NEAR(lisa.lisa_vals[i], lisa_new.lisa_vals[i], 1e-12);
+            EXPECT_DOUBLE_EQ(lisa.sig_local[i], lisa_new.sig_local[i]);
+        }
+    }
+}
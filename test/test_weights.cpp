@@ -3,12 +3,19 @@
 //
 
 #include <string>
+#include <algorithm>
 #include <limits.h>
+#include <ctime>
+#include <iostream>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
 #include "../src/gda_weights.h"
 #include "../src/geojson.h"
+#include "../src/contiguity.h"
+#include "../src/distance_weights.h"
+#include "../src/knn_weights.h"
+#include "../src/spatial_lag.h"
 
 using namespace testing;
 
@@ -48,6 +55,139 @@ namespace {
         delete w;
     }
 
+    void expect_same_neighbors(GeoDaWeight* w, const WeightsCSR& csr) {
+        ASSERT_EQ(w->num_obs, csr.num_obs);
+        for (int i=0; i<w->num_obs; ++i) {
+            std::vector<long> nbrs = w->GetNeighbors(i);
+            std::sort(nbrs.begin(), nbrs.end());
+            std::vector<long> csr_nbrs(csr.nbrs.begin() + csr.offsets[i], csr.nbrs.begin() + csr.offsets[i+1]);
+            std::sort(csr_nbrs.begin(), csr_nbrs.end());
+            EXPECT_EQ(nbrs, csr_nbrs);
+        }
+    }
+
+    TEST(WEIGHTS_TEST, CONTIG_CSR_SAME_AS_LIBGEODA) {
+        const char* files[3] = {"../data/Guerry.geojson", "../data/Columbus.geojson", "../data/sfcrime.geojson"};
+        double thresholds[2] = {0, 1e-6};
+
+        for (size_t f=0; f<3; ++f) {
+            GdaGeojson gda(files[f]);
+            for (size_t t=0; t<2; ++t) {
+                GeoDaWeight* queen = gda_queen_weights(&gda, 1, false, thresholds[t]);
+                expect_same_neighbors(queen, PolysToContigCSR(gda.GetMainMap(), true, thresholds[t], 1));
+                expect_same_neighbors(queen, PolysToContigCSR(gda.GetMainMap(), true, thresholds[t], 4));
+                delete queen;
+
+                GeoDaWeight* rook = gda_rook_weights(&gda, 1, false, thresholds[t]);
+                expect_same_neighbors(rook, PolysToContigCSR(gda.GetMainMap(), false, thresholds[t], 1));
+                expect_same_neighbors(rook, PolysToContigCSR(gda.GetMainMap(), false, thresholds[t], 4));
+                delete rook;
+            }
+        }
+    }
+
+    TEST(WEIGHTS_TEST, HIGHER_ORDER_CONTIG_SAME_AS_LIBGEODA) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        WeightsCSR first_order = PolysToContigCSR(gda.GetMainMap(), true, 0, 1);
+
+        for (unsigned int order=2; order<=4; ++order) {
+            GeoDaWeight* w = gda_queen_weights(&gda, order, false);
+            expect_same_neighbors(w, HigherOrderContiguity(first_order, order, false, 4));
+            delete w;
+
+            w = gda_queen_weights(&gda, order, true);
+            expect_same_neighbors(w, HigherOrderContiguity(first_order, order, true, 4));
+            delete w;
+        }
+    }
+
+    TEST(WEIGHTS_TEST, WEIGHTS_CACHE_EVICTION) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string queen_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        size_t queen_size = gda.GetWeightsSize(queen_uid);
+        EXPECT_GT(queen_size, 0);
+
+        size_t budget = WeightsCache::GetBudget();
+        WeightsCache::SetBudget(queen_size * 2);
+        std::vector<std::string> knn_uids;
+        for (unsigned int k=1; k<=6; ++k) {
+            knn_uids.push_back(gda.CreateKnnWeights(k, 1.0, false, false, false)->uid);
+        }
+        // the queen weights was least recently used: freed, but still valid
+        EXPECT_THAT(gda.GetWeightsSize(queen_uid), 0);
+        GeoDaWeight* w = gda.GetWeights(queen_uid);
+        ASSERT_TRUE(w != 0);
+        EXPECT_THAT(w->uid, queen_uid);
+        EXPECT_THAT(gda.GetWeightsSize(queen_uid), queen_size);
+
+        // same parameters, same uid
+        EXPECT_THAT(gda.CreateKnnWeights(3, 1.0, false, false, false)->uid, knn_uids[2]);
+
+        EXPECT_TRUE(gda.FreeWeights(knn_uids[2]));
+        EXPECT_FALSE(gda.FreeWeights(knn_uids[2]));
+        EXPECT_TRUE(gda.GetWeights(knn_uids[2]) == 0);
+        WeightsCache::SetBudget(budget);
+    }
+
+    TEST(WEIGHTS_TEST, WEIGHTS_CACHE_KERNEL_SHARED) {
+        std::vector<double> x, y, data;
+        for (int i=0; i<40; ++i) {
+            x.push_back((i * 7) % 40);
+            y.push_back((i * 13) % 11);
+            data.push_back(i % 5);
+        }
+        KnnNeighbors knn = KnnSearchAll(x, y, 4, 1);
+        std::vector<double> bandwidths = KnnBandwidths(knn, true);
+        WeightsCSR csr = KnnToKernelCSR(knn, KERNEL_QUARTIC, true, false);
+        WeightsCache cache;
+        cache.GetOrCreate("w_kernel", [&]() { return CSRToGeoDaWeight(csr); });
+        cache.SetKernelSpec("w_kernel", MakeKernelSpec(KERNEL_QUARTIC, bandwidths, false, x, y, false, false));
+        LagWeights explicit_w(cache.Get("w_kernel"));
+        std::vector<double> lag = SpatialLag(explicit_w, data, false, true, false);
+
+        // implicit LagWeights share the kernel of the cache, in the order of
+        // their rows, across changes of the spatial order
+        std::vector<int> reversed;
+        for (int i=39; i>=0; --i) reversed.push_back(i);
+        SpatialOrder orders[3] = {SpatialOrder(), MakeSpatialOrder(reversed), SpatialOrder()};
+        for (int k=0; k<3; ++k) {
+            LagWeights* lw = cache.GetLagWeights("w_kernel", orders[k], false, true);
+            ASSERT_TRUE(lw->IsImplicit());
+            EXPECT_EQ(lw->GetKernelSpec(), cache.GetKernelSpec("w_kernel"));
+            std::vector<double> implicit_lag = SpatialLag(*lw, data, false, true, false);
+            for (int i=0; i<40; ++i) EXPECT_NEAR(implicit_lag[i], lag[i], 1e-12);
+        }
+    }
+
+    TEST(WEIGHTS_TEST, WEIGHTS_CACHE_SIDE_DATA) {
+        size_t budget = WeightsCache::GetBudget();
+        WeightsCache cache;
+        bool released = false;
+        cache.SetSideData("knn00", 1000, [&]() { released = true; });
+        EXPECT_THAT(cache.GetTotalSize(), 1000);
+        EXPECT_TRUE(cache.UseSideData("knn00"));
+
+        // the side data is the least recently used: released over budget
+        WeightsCache::SetBudget(1500);
+        cache.SetSideData("mst00", 1000, []() {});
+        EXPECT_TRUE(released);
+        EXPECT_FALSE(cache.UseSideData("knn00"));
+        EXPECT_THAT(cache.GetTotalSize(), 1000);
+        WeightsCache::SetBudget(budget);
+
+        // a knn sweep keeps every result, even when the weights do not fit
+        GdaGeojson gda("../data/Guerry.geojson");
+        size_t knn_size = gda.GetWeightsSize(gda.CreateKnnWeights(8, 1.0, false, false, false)->uid);
+        WeightsCache::SetBudget(knn_size * 2);
+        std::vector<GeoDaWeight*> created;
+        std::vector<std::string> w_uids = gda.CreateKnnWeightsSweep(2, 8, 1.0, false, false, false,
+                                                                    [&](GeoDaWeight* w) { created.push_back(w); });
+        ASSERT_THAT(created.size(), w_uids.size());
+        EXPECT_THAT(created.back()->uid, w_uids.back());
+        EXPECT_THAT(created.back()->max_nbrs, 8);
+        WeightsCache::SetBudget(budget);
+    }
+
     TEST(WEIGHTS_TEST, KNN_CREATE) {
         std::string file_path = "../data/natregimes.geojson";
 
@@ -66,6 +206,293 @@ namespace {
         delete w;
     }
 
+    TEST(WEIGHTS_TEST, KNN_SAME_AS_LIBGEODA) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        const std::vector<gda::PointContents*>& cents = gda.GetCentroids();
+        std::vector<double> x, y;
+        for (size_t i=0; i<cents.size(); ++i) {
+            x.push_back(cents[i]->x);
+            y.push_back(cents[i]->y);
+        }
+
+        for (unsigned int k=1; k<=8; k*=2) {
+            GeoDaWeight* w = gda_knn_weights(&gda, k);
+            expect_same_neighbors(w, KnnToCSR(KnnSearchAll(x, y, k, 1), 1.0, false));
+            expect_same_neighbors(w, KnnToCSR(KnnSearchAll(x, y, k, 4), 1.0, false));
+            delete w;
+        }
+    }
+
+    TEST(WEIGHTS_TEST, KNN_SWEEP_SAME_AS_SINGLE_K) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::vector<std::string> w_uids = gda.CreateKnnWeightsSweep(2, 8, 1.0, false, false, false);
+        ASSERT_THAT(w_uids.size(), 7);
+
+        for (unsigned int k=2; k<=8; ++k) {
+            GeoDaWeight* w = gda_knn_weights(&gda, k);
+            GeoDaWeight* sweep_w = gda.GetWeights(w_uids[k-2]);
+            for (int i=0; i<w->num_obs; ++i) {
+                std::vector<long> nbrs = w->GetNeighbors(i), sweep_nbrs = sweep_w->GetNeighbors(i);
+                std::sort(nbrs.begin(), nbrs.end());
+                std::sort(sweep_nbrs.begin(), sweep_nbrs.end());
+                EXPECT_EQ(nbrs, sweep_nbrs);
+            }
+            delete w;
+        }
+    }
+
+    TEST(WEIGHTS_TEST, COMPONENTS_ISLANDS) {
+        // {0, 1, 2}, the island 3, {4, 5} where only 4 lists 5, and the island
+        // 6 that only lists itself
+        WeightsCSR csr;
+        csr.num_obs = 7;
+        csr.offsets = {0, 1, 3, 4, 4, 5, 5, 6};
+        csr.nbrs = {1, 0, 2, 1, 5, 6};
+        csr.is_symmetric = false;
+        GeoDaWeight* w = CSRToGeoDaWeight(csr);
+        WeightsComponents comp = FindComponents(w);
+
+        EXPECT_THAT(comp.num_components, 4);
+        EXPECT_FALSE(comp.IsConnected());
+        EXPECT_TRUE(comp.HasIslands());
+        EXPECT_EQ(comp.labels, std::vector<int>({0, 0, 0, 1, 2, 2, 3}));
+        EXPECT_EQ(comp.sizes, std::vector<int>({3, 1, 2, 1}));
+        EXPECT_EQ(comp.islands, std::vector<int>({3, 6}));
+        delete w;
+
+        // cached with the weights
+        GdaGeojson gda("../data/poly_w_islands.geojson");
+        std::string w_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        EXPECT_EQ(gda.GetWeightsComponents(w_uid), gda.GetWeightsComponents(w_uid));
+    }
+
+    gda::PolygonContents* make_polygon(const std::vector<gda::Point>& ring) {
+        gda::PolygonContents* poly = new gda::PolygonContents();
+        poly->num_parts = 1;
+        poly->parts.push_back(0);
+        poly->points = ring;
+        poly->num_points = (int)ring.size();
+        return poly;
+    }
+
+    TEST(WEIGHTS_TEST, ROOK_BOUNDARY_LENGTH_SQUARES) {
+        // two 2 x 3 rectangles sharing the edge x = 2, split at (2, 1.5) in
+        // both: the two halves are summed to 3
+        gda::MainMap main_map;
+        main_map.shape_type = gda::POLYGON;
+        main_map.num_obs = 2;
+        main_map.bbox_x_min = 0;
+        main_map.bbox_y_min = 0;
+        main_map.bbox_x_max = 4;
+        main_map.bbox_y_max = 3;
+        main_map.records.push_back(make_polygon({gda::Point(0, 0), gda::Point(0, 3), gda::Point(2, 3),
+                                                 gda::Point(2, 1.5), gda::Point(2, 0), gda::Point(0, 0)}));
+        main_map.records.push_back(make_polygon({gda::Point(2, 0), gda::Point(2, 1.5), gda::Point(2, 3),
+                                                 gda::Point(4, 3), gda::Point(4, 0), gda::Point(2, 0)}));
+
+        // without and with a precision threshold (each edge is then matched
+        // from both end points, and counted half each time)
+        double thresholds[2] = {0, 1e-6};
+        for (int t=0; t<2; ++t) {
+            WeightsCSR length_w = PolysToBoundaryLengthCSR(main_map, thresholds[t], 1);
+            ASSERT_THAT(length_w.num_obs, 2);
+            EXPECT_EQ(length_w.offsets, std::vector<size_t>({0, 1, 2}));
+            EXPECT_EQ(length_w.nbrs, std::vector<long>({1, 0}));
+            EXPECT_DOUBLE_EQ(length_w.weights[0], 3.0);
+            EXPECT_DOUBLE_EQ(length_w.weights[1], 3.0);
+        }
+    }
+
+    TEST(WEIGHTS_TEST, ROOK_BOUNDARY_LENGTH) {
+        GdaGeojson gda("../data/Columbus.geojson");
+        WeightsCSR rook = PolysToContigCSR(gda.GetMainMap(), false, 0, 1);
+        WeightsCSR length_w = PolysToBoundaryLengthCSR(gda.GetMainMap(), 0, 4);
+
+        // same neighbors as rook, with a positive length for each pair
+        EXPECT_EQ(rook.offsets, length_w.offsets);
+        EXPECT_EQ(rook.nbrs, length_w.nbrs);
+        for (int i=0; i<length_w.num_obs; ++i) {
+            for (size_t k=length_w.offsets[i]; k<length_w.offsets[i+1]; ++k) {
+                EXPECT_GT(length_w.weights[k], 0);
+                // symmetric
+                long j = length_w.nbrs[k];
+                std::vector<long>::const_iterator it = std::find(length_w.nbrs.begin() + length_w.offsets[j],
+                                                                 length_w.nbrs.begin() + length_w.offsets[j+1], i);
+                EXPECT_DOUBLE_EQ(length_w.weights[it - length_w.nbrs.begin()], length_w.weights[k]);
+            }
+        }
+    }
+
+    TEST(WEIGHTS_TEST, QUEEN_FILL_ISLANDS) {
+        // the chain 0 - 1 - 2 - 3 on the x axis, the islands 4 (right of 3)
+        // and 5 (left of 0)
+        WeightsCSR csr;
+        csr.num_obs = 6;
+        csr.offsets = {0, 1, 3, 5, 6, 6, 6};
+        csr.nbrs = {1, 0, 2, 1, 3, 2};
+        csr.is_symmetric = true;
+        std::vector<double> x = {0, 1, 2, 3, 10, -5};
+        std::vector<double> y = {0, 0.1, 0, 0.1, 0.5, 0.3};
+        WeightsCSR filled = FillIslandsWithKnn(csr, x, y, 2);
+
+        ASSERT_THAT(filled.num_obs, 6);
+        std::vector<std::vector<long> > expected = {{1, 5}, {0, 2, 5}, {1, 3, 4}, {2, 4}, {2, 3}, {0, 1}};
+        for (int i=0; i<filled.num_obs; ++i) {
+            std::vector<long> row(filled.nbrs.begin() + filled.offsets[i], filled.nbrs.begin() + filled.offsets[i+1]);
+            EXPECT_EQ(row, expected[i]);
+        }
+        EXPECT_TRUE(filled.is_symmetric);
+
+        // the former islands have exactly k neighbors, every added pair is
+        // in both rows, and the other rows only gained islands
+        for (int i=0; i<filled.num_obs; ++i) {
+            std::vector<long> row(filled.nbrs.begin() + filled.offsets[i], filled.nbrs.begin() + filled.offsets[i+1]);
+            if (i >= 4) EXPECT_THAT(row.size(), 2);
+            for (size_t k=0; k<row.size(); ++k) {
+                long j = row[k];
+                EXPECT_TRUE(std::find(filled.nbrs.begin() + filled.offsets[j],
+                                      filled.nbrs.begin() + filled.offsets[j+1], i) !=
+                            filled.nbrs.begin() + filled.offsets[j+1]);
+            }
+            if (i < 4) {
+                std::vector<long> kept;
+                for (size_t k=0; k<row.size(); ++k) {
+                    if (row[k] < 4) kept.push_back(row[k]);
+                }
+                EXPECT_EQ(kept, std::vector<long>(csr.nbrs.begin() + csr.offsets[i],
+                                                  csr.nbrs.begin() + csr.offsets[i+1]));
+            }
+        }
+
+        // filled weights get their own uid
+        GdaGeojson gda("../data/poly_w_islands.geojson");
+        std::string queen_uid = gda.CreateQueenWeights(1, false, 0)->uid;
+        EXPECT_NE(queen_uid, gda.CreateQueenWeights(1, false, 0, 2)->uid);
+    }
+
+    TEST(WEIGHTS_TEST, SPATIAL_LAG_KERNEL) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        std::string w_uid = gda.CreateKernelKnnWeights(6, "triangular", true, true, 1.0, false, false, false)->uid;
+        LagWeights* lw = gda.GetLagWeights(w_uid);
+        ASSERT_TRUE(lw->HasDiagonal());
+
+        std::vector<double> data(lw->GetNumObs(), 1.0);
+        std::vector<double> lag = SpatialLag(*lw, data, false, true, false);
+        std::vector<double> bin_lag = SpatialLag(*lw, data, true, false, true);
+        for (int i=0; i<lw->GetNumObs(); ++i) {
+            // row-standardized lag of a constant is the constant
+            EXPECT_NEAR(lag[i], 1.0, 1e-12);
+            EXPECT_DOUBLE_EQ(bin_lag[i], 7.0);
+        }
+    }
+
+    TEST(WEIGHTS_TEST, SPATIAL_LAG_COMPACT) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        GeoDaWeight* w = gda.CreateDistanceWeights(100000, 1.0, true, false, false);
+        std::vector<double> data = gda.GetNumericCol("Crm_prs");
+
+        LagWeights full_w(w), compact_w(w, SpatialOrder(), true);
+        ASSERT_TRUE(compact_w.IsCompact());
+        EXPECT_LT(compact_w.GetMemorySize(), full_w.GetMemorySize());
+
+        std::vector<double> lag = SpatialLag(full_w, data, false, true, false);
+        std::vector<double> compact_lag = SpatialLag(compact_w, data, false, true, false);
+        for (size_t i=0; i<lag.size(); ++i) {
+            // float weights
+            EXPECT_NEAR(lag[i], compact_lag[i], 1e-6 * lag[i]);
+        }
+    }
+
+    TEST(WEIGHTS_TEST, SPATIAL_LAG_IMPLICIT_KERNEL) {
+        GdaGeojson gda("../data/natregimes.geojson");
+        std::string w_uid = gda.CreateKernelKnnWeights(10, "epanechnikov", true, true, 1.0, false, false, false)->uid;
+        std::vector<double> data = gda.GetNumericCol("HR90");
+        std::vector<double> lag = SpatialLag(*gda.GetLagWeights(w_uid), data, false, true, false);
+
+        gda.SetImplicitKernelWeights(true);
+        LagWeights* lw = gda.GetLagWeights(w_uid);
+        ASSERT_TRUE(lw->IsImplicit());
+        std::vector<double> implicit_lag = SpatialLag(*lw, data, false, true, false);
+        for (size_t i=0; i<lag.size(); ++i) {
+            EXPECT_NEAR(lag[i], implicit_lag[i], 1e-12 * (1 + lag[i]));
+        }
+    }
+
+    TEST(WEIGHTS_TEST, SPATIAL_ORDER_SAME_LAGS) {
+        GdaGeojson gda("../data/natregimes.geojson");
+        std::string w_uid = gda.CreateKnnWeights(8, 1.0, false, false, false)->uid;
+        std::vector<double> data = gda.GetNumericCol("HR90");
+
+        std::vector<std::vector<double> > lags(2);
+        for (int use_order=0; use_order<2; ++use_order) {
+            gda.SetSpatialOrder(use_order == 1);
+            lags[use_order] = SpatialLag(*gda.GetLagWeights(w_uid), data, false, true, false);
+        }
+        ASSERT_THAT(lags[0].size(), 3085);
+        for (size_t i=0; i<lags[0].size(); ++i) {
+            EXPECT_NEAR(lags[0][i], lags[1][i], 1e-12);
+        }
+    }
+
+    // timing only: run with --gtest_also_run_disabled_tests
+    TEST(WEIGHTS_TEST, DISABLED_SPATIAL_ORDER_BENCHMARK) {
+        // natregimes is in state/county order; compare the lag loops in file
+        // order and in the Hilbert order of the centroids
+        GdaGeojson gda("../data/natregimes.geojson");
+        std::string w_uid = gda.CreateKnnWeights(8, 1.0, false, false, false)->uid;
+        std::vector<double> data = gda.GetNumericCol("HR90");
+
+        for (int use_order=0; use_order<2; ++use_order) {
+            gda.SetSpatialOrder(use_order == 1);
+            LagWeights* lw = gda.GetLagWeights(w_uid);
+            clock_t start = clock();
+            for (int i=0; i<1000; ++i) {
+                SpatialLag(*lw, data, false, true, false);
+            }
+            std::cout << (use_order ? "hilbert order: " : "file order: ")
+                      << double(clock() - start) / CLOCKS_PER_SEC << "s / 1000 lags" << std::endl;
+        }
+    }
+
+    TEST(WEIGHTS_TEST, DIST_BAND_SAME_AS_LIBGEODA) {
+        GdaGeojson gda("../data/Guerry.geojson");
+        const std::vector<gda::PointContents*>& cents = gda.GetCentroids();
+        std::vector<double> x, y;
+        for (size_t i=0; i<cents.size(); ++i) {
+            x.push_back(cents[i]->x);
+            y.push_back(cents[i]->y);
+        }
+
+        double min_thres = gda_min_distthreshold(&gda);
+        for (int f=1; f<=3; ++f) {
+            GeoDaWeight* w = gda_distance_weights(&gda, min_thres * f);
+            WeightsCSR csr = DistanceBandCSR(x, y, min_thres * f, 4);
+            expect_same_neighbors(w, csr);
+            EXPECT_THAT(CountDistanceBand(x, y, min_thres * f, 4), csr.GetNumNonZeros());
+            delete w;
+        }
+    }
+
+    TEST(WEIGHTS_TEST, ARC_DISTANCE_BAND_EXACT) {
+        // points around the north pole and across the antimeridian
+        double lon[6] = {0, 90, 180, -90, 179.9, -179.9};
+        double lat[6] = {89.9, 89.9, 89.9, 89.9, 0, 0};
+        std::vector<double> x(lon, lon + 6), y(lat, lat + 6);
+
+        // the polar points are 0.14 or 0.2 degree of arc apart, the points at
+        // the equator 0.2 degree
+        double deg_km = 6371.0 * M_PI / 180.0;
+        WeightsCSR csr = DistanceBandArc(x, y, 0.25 * deg_km, false, 2);
+        EXPECT_THAT(csr.GetNbrSize(0), 3);
+        EXPECT_THAT(csr.GetNbrSize(4), 1);
+        EXPECT_THAT(csr.nbrs[csr.offsets[4]], 5);
+        EXPECT_NEAR(csr.weights[csr.offsets[4]], 0.2 * deg_km, 1e-6);
+
+        KnnNeighbors knn = KnnSearchAllArc(x, y, 1, false, 2);
+        EXPECT_THAT(knn.nbrs[5], 4);
+        EXPECT_NEAR(knn.dists[5], 0.2 * deg_km, 1e-6);
+    }
+
     TEST(WEIGHTS_TEST, DIST_CREATE) {
         std::string file_path = "../data/natregimes.geojson";
 
@@ -88,6 +515,19 @@ namespace {
         delete w;
     }
 
+    TEST(WEIGHTS_TEST, MIN_THRESHOLD_FROM_MST) {
+        GdaGeojson gda("../data/natregimes.geojson");
+
+        EXPECT_DOUBLE_EQ(gda.GetMinDistanceThreshold(false, false), gda_min_distthreshold(&gda));
+
+        // the longest MST edge connects all observations
+        double thres = gda.GetConnectivityThreshold(false, false);
+        EXPECT_GE(thres, gda.GetMinDistanceThreshold(false, false));
+        const DistanceMST& mst = gda.GetDistanceMST(false, false);
+        EXPECT_THAT(mst.dist.size(), gda.GetNumObs() - 1);
+        EXPECT_DOUBLE_EQ(mst.dist.back(), thres);
+    }
+
     TEST(WEIGHTS_TEST, KERNEL_KNN) {
         std::string file_path = "../data/natregimes.geojson";
 